@@ -49,6 +49,7 @@
 
 #include "bitmap.h"
 #include "nand_ring_test.h"
+#include "nand_ring_bench.h"
 #include "nand_log_test.h"
 
 /*
@@ -206,6 +207,11 @@ int main(void) {
   nand_wp_release();
   nandRingTest(&NAND, &nandcfg, &badblock_map);
   nandRingIteratorTest(&NAND, &nandcfg, &badblock_map);
+  //nandRingMountBench(&NAND, &nandcfg, &badblock_map);
+  //nandRingWriteBench(&NAND, &nandcfg, &badblock_map);
+  //nandRingEraseAheadBench(&NAND, &nandcfg, &badblock_map);
+  //nandRingCursorBench(&NAND, &nandcfg, &badblock_map);
+  //nandLogProducerBench(&NAND, &nandcfg, &badblock_map);
   //nandLogTest(&NAND, &nandcfg, &badblock_map);
   nand_wp_assert();
 
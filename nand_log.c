@@ -11,7 +11,9 @@
  ******************************************************************************
  */
 
-#define FETCH_TIMEOUT     (MS2ST(100))
+/* mailbox messages which are not buffer pointers */
+#define MSG_STOP          ((msg_t)0)
+#define MSG_WAKE          ((msg_t)1)
 
 /*
  ******************************************************************************
@@ -40,61 +42,577 @@
  */
 
 /**
- * @brief post_full_buffer
+ * @brief   Position of buffer in pool, used as index of per buffer tables.
+ */
+static size_t buffer_index(const NandLog *log, const uint8_t *buf) {
+
+  return (buf - log->mempool_buf) / log->ring->config->nandp->config->page_data_size;
+}
+
+/**
+ * @brief   Post current buffer to worker together with its fill level.
  * @param log
- * @note  There is no checks of mailbox post status because it has the
- *        same size as memory pool.
+ * @note  Mailbox may be occupied by wake requests, so post waits for
+ *        room. Worker never waits for producer, so it can not deadlock.
  */
-static void post_full_buffer(NandLog *log) {
+static void post_buffer(NandLog *log) {
 
   const size_t pagesize = log->ring->config->nandp->config->page_data_size;
-  msg_t msg = (msg_t)(log->btip - pagesize);
+  const size_t used = pagesize - log->bfree;
+  uint8_t *buf = log->btip - used;
 
-  chMBPost(&log->mb, msg, TIME_IMMEDIATE);
+  log->blen[buffer_index(log, buf)] = used;
+  chMBPost(&log->mb, (msg_t)buf, TIME_INFINITE);
 }
 
 /**
- * @brief zero_tail
- * @param log
+ * @brief   Return buffer to pool and wake producer waiting for it.
  */
-void zero_tail(NandLog *log) {
+static void free_buffer(NandLog *log, uint8_t *buf) {
 
-  if ((NULL != log->btip) && (log->bfree > 0)) {
-    memset(log->btip, 0, log->bfree);
-    log->btip += log->bfree;
+  chPoolFree(&log->mempool, buf);
+  chSemSignal(&log->free_sem);
+}
+
+/**
+ * @brief   Allocate buffer after successful semaphore wait and update
+ *          high water mark.
+ */
+static uint8_t *pool_alloc(NandLog *log) {
+
+  osalSysLock();
+  const uint32_t used = log->config->depth - chSemGetCounterI(&log->free_sem);
+  osalSysUnlock();
+  if (used > log->dbg.high_water)
+    log->dbg.high_water = used;
+
+  uint8_t *buf = chPoolAlloc(&log->mempool);
+  log->bfirst[buffer_index(log, buf)] = NAND_RING_NO_RECORD;
+  return buf;
+}
+
+/**
+ * @brief   Take the oldest buffer not yet fetched by worker, its data
+ *          is lost.
+ * @retval  NULL if worker already got all posted buffers.
+ */
+static uint8_t *steal_oldest(NandLog *log) {
+
+  msg_t msg;
+
+  while (MSG_OK == chMBFetch(&log->mb, &msg, TIME_IMMEDIATE)) {
+    if (MSG_WAKE != msg) {
+      uint8_t *buf = (uint8_t *)msg;
+      const size_t idx = buffer_index(log, buf);
+      log->dbg.dropped_pages++;
+      log->dbg.dropped_bytes += log->blen[idx];
+      log->bfirst[idx] = NAND_RING_NO_RECORD;
+      return buf;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief   Allocate empty buffer from pool without waiting.
+ */
+static uint8_t *alloc_buffer(NandLog *log) {
+
+  if (MSG_OK == chSemWaitTimeout(&log->free_sem, TIME_IMMEDIATE))
+    return pool_alloc(log);
+  return NULL;
+}
+
+/**
+ * @brief   Apply overflow policy to get buffer when pool is empty.
+ * @note    Must be called with producer lock held. Lock is released
+ *          while waiting, so other producers may fill the current page
+ *          meanwhile and caller has to check buffer state again.
+ */
+static uint8_t *wait_buffer(NandLog *log) {
+
+  systime_t timeout = TIME_INFINITE;
+
+  switch (log->overflow) {
+  case NAND_LOG_OVERFLOW_DROP_NEWEST:
+    return NULL;
+  case NAND_LOG_OVERFLOW_DROP_OLDEST: {
+    uint8_t *buf = steal_oldest(log);
+    if (NULL != buf)
+      return buf;
+    /* worker is writing all buffers right now, they will be free soon */
+    break;
+  }
+  case NAND_LOG_OVERFLOW_TIMEOUT:
+    timeout = log->overflow_timeout;
+    break;
+  default:
+    break;
+  }
+
+  chMtxUnlock(&log->lock);
+  const rtcnt_t start = chSysGetRealtimeCounterX();
+  const msg_t status = chSemWaitTimeout(&log->free_sem, timeout);
+  const uint32_t us = RTC2US(halGetCounterFrequency(), chSysGetRealtimeCounterX() - start);
+  chMtxLock(&log->lock);
+
+  log->dbg.blocked_us += us;
+  if (us > log->dbg.blocked_max_us)
+    log->dbg.blocked_max_us = us;
+
+  if (MSG_OK != status)
+    return NULL;
+  if (NAND_LOG_READY != log->state) {
+    /* log stopped while waiting */
+    chSemSignal(&log->free_sem);
+    return NULL;
+  }
+  return pool_alloc(log);
+}
+
+/**
+ * @brief   Get empty buffer, previously reserved one goes first.
+ */
+static uint8_t *take_buffer(NandLog *log) {
+
+  uint8_t *ret = log->bnext;
+
+  if (NULL != ret)
+    log->bnext = NULL;
+  else
+    ret = alloc_buffer(log);
+
+  return ret;
+}
+
+/**
+ * @brief   Put buffer obtained by waiting where reservation needs it.
+ */
+static void park_buffer(NandLog *log, uint8_t *buf) {
+
+  const size_t pds = log->ring->config->nandp->config->page_data_size;
+
+  if (NULL == log->btip) {
+    log->btip = buf;
+    log->bfree = pds;
+  }
+  else if (NULL == log->bnext) {
+    log->bnext = buf;
+  }
+  else {
+    free_buffer(log, buf);
+  }
+}
+
+/**
+ * @brief   Seal partially filled buffer and start new one.
+ * @note    Must be called with producer lock held.
+ */
+static void flush_locked(NandLog *log) {
+
+  const size_t pds = log->ring->config->nandp->config->page_data_size;
+
+  if ((NULL != log->btip) && (log->bfree < pds)) {
+    post_buffer(log);
+    log->bfree = pds;
+    log->btip  = take_buffer(log);
+  }
+}
+
+/**
+ * @brief   Flush current buffer if its oldest byte waits too long.
+ * @note    Called by worker, so it never waits for producer.
+ */
+static void auto_flush(NandLog *log) {
+
+  if ((0 != log->flush_period) && chMtxTryLock(&log->lock)) {
+    if ((NULL != log->btip) && (log->bfree < log->ring->config->nandp->config->page_data_size)
+        && (chVTTimeElapsedSinceX(log->bstamp) >= log->flush_period)) {
+      flush_locked(log);
+    }
+    chMtxUnlock(&log->lock);
+  }
+}
+
+/**
+ * @brief   Collect all full buffers posted so far and write them to ring
+ *          using single call.
+ * @param[in] data  array of NAND_LOG_BATCH_MAX pointers, the first one
+ *                  must be already fetched
+ * @param[out] stop set when stop request found in mailbox
+ * @return  Number of buffers which could not be written.
+ */
+static size_t drain_buffers(NandLog *log, uint8_t **data, bool *stop) {
+
+  uint16_t used[NAND_LOG_BATCH_MAX];
+  uint16_t first[NAND_LOG_BATCH_MAX];
+  msg_t msg;
+  size_t n = 1;
+  while ((n < NAND_LOG_BATCH_MAX) &&
+         (MSG_OK == chMBFetch(&log->mb, &msg, TIME_IMMEDIATE))) {
+    if (MSG_STOP == msg) {
+      *stop = true;
+      break;
+    }
+    else if (MSG_WAKE != msg) {
+      data[n] = (uint8_t *)msg;
+      n++;
+    }
+  }
+  for (size_t i=0; i<n; i++) {
+    const size_t idx = buffer_index(log, data[i]);
+    used[i] = log->blen[idx];
+    first[i] = log->bfirst[idx];
+  }
+
+  NANDDriver *nandp = log->ring->config->nandp;
+  const rtcnt_t wait = chSysGetRealtimeCounterX();
+  nandAcquireBus(nandp);
+  const rtcnt_t start = chSysGetRealtimeCounterX();
+  const uint32_t us = RTC2US(halGetCounterFrequency(), start - wait);
+  log->dbg.bus_wait_us += us;
+  if (us > log->dbg.bus_wait_max_us)
+    log->dbg.bus_wait_max_us = us;
+  const size_t written = nandRingWritePagesv(log->ring,
+                          (const uint8_t * const *)data, used, first, n);
+  log->dbg.write_us += RTC2US(halGetCounterFrequency(), chSysGetRealtimeCounterX() - start);
+  nandReleaseBus(nandp);
+
+  for (size_t i=0; i<written; i++) {
+    log->dbg.pages_written++;
+    log->dbg.bytes_written += used[i];
+  }
+  for (size_t i=0; i<n; i++) {
+    free_buffer(log, data[i]);
   }
+
+  return n - written;
+}
+
+/**
+ * @brief   Refill erase-ahead reserve of log's ring by single block.
+ */
+static size_t erase_ahead(NandLog *log) {
+
+  NANDDriver *nandp = log->ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const size_t ret = nandRingEraseAhead(log->ring);
+  nandReleaseBus(nandp);
+
+  return ret;
 }
 
 /**
- *
+ * @brief   Worker sleeps on mailbox until buffer or stop request arrives.
+ * @details Periodic wakeups happen only when time based auto flush
+ *          enabled or erase-ahead reserve needs refilling.
+ * @note    Every log has its own worker, NAND bus is shared between
+ *          them using driver's mutual exclusion.
  */
-static THD_WORKING_AREA(NandWorkerThreadWA, 320);
 static THD_FUNCTION(NandWorker, arg) {
   chRegSetThreadName("NandLog");
   NandLog *self = arg;
-  uint8_t *data = NULL;
+  uint8_t *data[NAND_LOG_BATCH_MAX];
+  size_t erase_pending = erase_ahead(self);
+  bool stop = false;
+  msg_t msg;
 
-  while (! chThdShouldTerminateX()) {
-    if (MSG_OK == chMBFetch(&self->mb, (msg_t *)(&data), FETCH_TIMEOUT)) {
-      bool status = nandRingWritePage(self->ring, data);
-      if (OSAL_SUCCESS != status) {
-        self->state = NAND_LOG_NO_SPACE;
+  while (! stop) {
+    /* do not sleep while erase-ahead reserve needs refilling */
+    systime_t timeout = TIME_INFINITE;
+    if (erase_pending > 0)
+      timeout = TIME_IMMEDIATE;
+    else if (0 != self->flush_period)
+      timeout = self->flush_period;
+
+    if (MSG_OK == chMBFetch(&self->mb, &msg, timeout)) {
+      if (MSG_STOP == msg) {
+        stop = true;
+      }
+      else if (MSG_WAKE != msg) {
+        data[0] = (uint8_t *)msg;
+        if (drain_buffers(self, data, &stop) > 0) {
+          /* stop request must not be overwritten */
+          chMtxLock(&self->lock);
+          if (NAND_LOG_READY == self->state)
+            self->state = NAND_LOG_NO_SPACE;
+          chMtxUnlock(&self->lock);
+        }
+        erase_pending = 1;
       }
-      chPoolFree(&self->mempool, data);
     }
+    else if (erase_pending > 0) {
+      erase_pending = erase_ahead(self);
+    }
+    auto_flush(self);
   }
 
-  /* flush data and free all allocated buffers if any */
-  osalSysLock();
-  size_t used = chMBGetUsedCountI(&self->mb);
-  osalSysUnlock();
-  while (used--) {
-    chMBFetch(&self->mb, (msg_t *)(&data), TIME_IMMEDIATE);
-    nandRingWritePage(self->ring, data);
-    chPoolFree(&self->mempool, data);
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Take producer lock counting collisions with other producers.
+ * @return  False when log is stopped, lock is not held then.
+ */
+static bool producer_lock(NandLog *log) {
+
+  if (! chMtxTryLock(&log->lock)) {
+    chMtxLock(&log->lock);
+    log->dbg.lock_contended++;
   }
+  if (NAND_LOG_STOP != log->state)
+    return true;
 
-  chThdExit(MSG_OK);
+  chMtxUnlock(&log->lock);
+  return false;
+}
+
+/**
+ * @brief   Reserve room in page buffers so producer can serialize data
+ *          directly in place.
+ * @note    Must be called with producer lock held.
+ * @param[in] len     bytes to reserve, not more than page data size
+ * @param[out] span   one or two areas to be filled by producer
+ * @return  Size of actually reserved area. It is less than requested
+ *          when memory pool exhausted.
+ */
+static size_t reserve_locked(NandLog *log, size_t len, NandLogSpan *span) {
+
+  osalDbgCheck((NULL != span) && (0 != len));
+
+  span->data[0] = NULL;
+  span->data[1] = NULL;
+  span->len[0]  = 0;
+  span->len[1]  = 0;
+
+  /* stopped log may have no ring */
+  if (NAND_LOG_READY != log->state)
+    return 0;
+  /* span covers at most two buffers, release builds must not
+     overrun the second one */
+  const size_t pds = log->ring->config->nandp->config->page_data_size;
+  if (len > pds)
+    return 0;
+
+  /* get buffers first, waiting drops the lock, so state is checked
+     again after every wait */
+  while (true) {
+    if (NAND_LOG_READY != log->state)
+      return 0;
+    osalDbgCheck(0 == log->reserved);
+
+    if (NULL == log->btip) {
+      log->btip = take_buffer(log);
+      if (NULL != log->btip) {
+        log->bfree = pds;
+        continue;
+      }
+    }
+    else if ((len > log->bfree) && (NULL == log->bnext)) {
+      log->bnext = alloc_buffer(log);
+      if (NULL != log->bnext)
+        continue;
+    }
+    else {
+      break;
+    }
+
+    uint8_t *buf = wait_buffer(log);
+    if (NULL == buf)
+      break;
+    park_buffer(log, buf);
+  }
+
+  /* all buffers was exhausted */
+  if (NULL == log->btip)
+    return 0;
+
+  span->data[0] = log->btip;
+  if (len <= log->bfree) {
+    span->len[0] = len;
+  }
+  else {
+    span->len[0] = log->bfree;
+    if (NULL != log->bnext) {
+      span->data[1] = log->bnext;
+      span->len[1]  = len - log->bfree;
+    }
+  }
+
+  log->reserved = span->len[0] + span->len[1];
+  return log->reserved;
+}
+
+/**
+ * @brief   Publish reserved data, producer lock stays held.
+ * @param[in] len   bytes actually filled, may be less than reserved
+ */
+static void commit_locked(NandLog *log, size_t len) {
+
+  osalDbgCheck(len <= log->reserved);
+  log->reserved = 0;
+  if (0 == len) {
+    /* nothing to publish, ring may be already detached by stop */
+    return;
+  }
+
+  log->dbg.committed_bytes += len;
+  const size_t pds = log->ring->config->nandp->config->page_data_size;
+
+  if (len < log->bfree) {
+    if (pds == log->bfree)
+      log->bstamp = chVTGetSystemTimeX();
+    log->btip  += len;
+    log->bfree -= len;
+  }
+  else {
+    const size_t rest = len - log->bfree;
+    log->btip += log->bfree;
+    log->bfree = 0;
+    post_buffer(log);
+
+    log->bfree = pds;
+    log->btip  = take_buffer(log);
+    if (NULL == log->btip) {
+      /* memory pool exhausted */
+      osalDbgCheck(0 == rest);
+    }
+    else if (rest > 0) {
+      log->bstamp = chVTGetSystemTimeX();
+      log->btip  += rest;
+      log->bfree -= rest;
+    }
+  }
+
+  if ((0 != log->flush_size) && ((pds - log->bfree) >= log->flush_size)) {
+    flush_locked(log);
+  }
+}
+
+/**
+ * @brief   Append several fragments as single piece, all or nothing.
+ * @note    Must be called with producer lock held.
+ * @param[in] record  fragments form framed record, its start gets
+ *                    registered for page header
+ */
+static size_t append_locked(NandLog *log, const NandLogIovec *iov,
+                            size_t iovcnt, size_t total, bool record) {
+
+  const size_t pds = log->ring->config->nandp->config->page_data_size;
+  NandLogSpan span;
+
+  size_t got;
+  while (true) {
+    /* record header must not cross page boundary */
+    if (record && (log->bfree < sizeof(NandLogRecord))) {
+      flush_locked(log);
+    }
+    got = reserve_locked(log, total, &span);
+    if ((! record) || (total != got) || (span.len[0] >= sizeof(NandLogRecord)))
+      break;
+    /* other producers filled page while this one waited for buffer */
+    commit_locked(log, 0);
+  }
+
+  if (total != got) {
+    commit_locked(log, 0);
+    log->dbg.dropped_bytes += total;
+    log->dbg.dropped_writes++;
+    return 0;
+  }
+
+  if (record) {
+    const size_t idx = buffer_index(log, span.data[0]);
+    if (NAND_RING_NO_RECORD == log->bfirst[idx])
+      log->bfirst[idx] = pds - log->bfree;
+  }
+
+  /* single pass over fragments and spans */
+  size_t s = 0;
+  uint8_t *dst = span.data[0];
+  size_t room = span.len[0];
+  for (size_t i=0; i<iovcnt; i++) {
+    const uint8_t *src = iov[i].data;
+    size_t len = iov[i].len;
+    while (len > 0) {
+      if (0 == room) {
+        s++;
+        dst = span.data[s];
+        room = span.len[s];
+      }
+      const size_t n = (len < room) ? len : room;
+      memcpy(dst, src, n);
+      dst  += n;
+      src  += n;
+      room -= n;
+      len  -= n;
+    }
+  }
+
+  commit_locked(log, total);
+  return total;
+}
+
+/**
+ * @brief   Read header and data of page at reader position.
+ * @return  False when page does not hold valid data, i.e. end of log.
+ */
+static bool reader_load(NandLogReader *reader) {
+
+  NandPageHeader header;
+  nand_ring_read_t status;
+  uint64_t skipped = 0;
+
+  while (true) {
+    status = nandRingReadPage(reader->ring, reader->blk, reader->page,
+                              reader->buf, &header);
+    if (NAND_RING_READ_NO_DATA == status)
+      return false;
+    /* ring wrapped to older data */
+    if (reader->loaded && (header.id <= reader->id))
+      return false;
+    if (NAND_RING_SUMMARY_PAGE != header.first_record)
+      break;
+    /* block summary does not break record stream */
+    skipped++;
+    nandRingNextPage(reader->ring, &reader->blk, &reader->page);
+  }
+
+  reader->consecutive = reader->loaded && (header.id == reader->id + 1 + skipped);
+  reader->loaded = true;
+  reader->id = header.id;
+  reader->written = header.written;
+  reader->first = header.first_record;
+  reader->pos = 0;
+
+  /* broken data looks like empty gap, reader resyncs after it */
+  if (NAND_RING_READ_ECC_FAILED == status) {
+    reader->written = 0;
+    reader->first = NAND_RING_NO_RECORD;
+    reader->consecutive = false;
+  }
+  return true;
+}
+
+/**
+ * @brief   Move reader to the next page in ring.
+ */
+static bool reader_advance(NandLogReader *reader) {
+
+  nandRingNextPage(reader->ring, &reader->blk, &reader->page);
+  return reader_load(reader);
+}
+
+/**
+ * @brief   Drop partially read record and synchronize at the next
+ *          record start.
+ */
+static void reader_resync(NandLogReader *reader) {
+
+  reader->torn++;
+  reader->synced = false;
 }
 
 /*
@@ -109,47 +627,93 @@ static THD_FUNCTION(NandWorker, arg) {
  */
 void nandLogObjectInit(NandLog *log) {
 
-  chMBObjectInit(&log->mb, log->mailbox_buf, NAND_BUFFER_COUNT);
-
   log->worker = NULL;
   log->ring = NULL;
+  log->config = NULL;
+  log->blen = NULL;
+  log->bfirst = NULL;
   log->state = NAND_LOG_STOP;
 
+  chMtxObjectInit(&log->lock);
+
   log->bfree = 0;
   log->btip = NULL;
+  log->bnext = NULL;
+  log->reserved = 0;
+  log->bstamp = 0;
   log->mempool_buf = NULL;
+
+  log->flush_period = 0;
+  log->flush_size = 0;
+  log->overflow = NAND_LOG_OVERFLOW_DROP_NEWEST;
+  log->overflow_timeout = TIME_IMMEDIATE;
+  memset(&log->dbg, 0, sizeof(log->dbg));
+}
+
+/**
+ * @brief   Size of arena needed for log with specified depth.
+ * @details Arena holds page buffers, worker mailbox with extra slot for
+ *          stop request, tables of buffer fill levels and record starts.
+ */
+size_t nandLogArenaSize(const NANDDriver *nandp, size_t depth) {
+
+  osalDbgCheck((NULL != nandp) && (depth > 0));
+  const size_t pds = nandp->config->page_data_size;
+
+  return depth * pds + (depth + 1) * sizeof(msg_t) + 2 * depth * sizeof(uint16_t);
 }
 
 /**
  * @brief nandLogStart
  * @param log
+ * @param config
  * @param ring
  */
-void nandLogStart(NandLog *log, NandRing *ring,
+void nandLogStart(NandLog *log, const NandLogConfig *config, NandRing *ring,
                const NandRingConfig *nandringcfg, uint8_t *ring_working_area) {
 
-  osalDbgCheck((NULL != log) && (NULL != ring) && (NULL != nandringcfg)
-               && (NULL != ring_working_area));
+  osalDbgCheck((NULL != log) && (NULL != config) && (NULL != ring)
+               && (NULL != nandringcfg) && (NULL != ring_working_area));
+  osalDbgCheck((NULL != config->arena) && (config->depth > 0));
+  osalDbgCheck(0 == ((uintptr_t)config->arena % sizeof(msg_t)));
+  osalDbgCheck((NULL != config->worker_wa) && (config->worker_wa_size > 0));
 
+  /* other logs may use the same NAND right now */
+  nandAcquireBus(nandringcfg->nandp);
   nandRingStart(ring, nandringcfg, ring_working_area);
   osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  nandReleaseBus(nandringcfg->nandp);
 
   osalDbgCheck(NAND_RING_MOUNTED == ring->state);
   const size_t pagesize = ring->config->nandp->config->page_data_size;
+  const size_t depth = config->depth;
+  osalDbgCheck(0 == (pagesize % sizeof(msg_t)));
 
-  /* pool pointer does not nulls during stop procedure */
-  if (NULL == log->mempool_buf) {
-    log->mempool_buf = chCoreAlloc(pagesize * NAND_BUFFER_COUNT);
-    chPoolObjectInit(&log->mempool, pagesize, NULL);
-    chPoolLoadArray(&log->mempool, log->mempool_buf, NAND_BUFFER_COUNT);
-  }
+  /* arena layout: page buffers, mailbox, fill levels, record starts */
+  log->config = config;
+  log->mempool_buf = config->arena;
+  msg_t *mailbox_buf = (msg_t *)&config->arena[depth * pagesize];
+  log->blen = (uint16_t *)&mailbox_buf[depth + 1];
+  log->bfirst = &log->blen[depth];
+  chMBObjectInit(&log->mb, mailbox_buf, depth + 1);
+  chPoolObjectInit(&log->mempool, pagesize, NULL);
+  chPoolLoadArray(&log->mempool, log->mempool_buf, depth);
+  chSemObjectInit(&log->free_sem, depth);
+
+  log->flush_period = config->flush_period;
+  log->flush_size = config->flush_size;
+  log->overflow = config->overflow;
+  log->overflow_timeout = config->overflow_timeout;
+  memset(&log->dbg, 0, sizeof(log->dbg));
 
   log->ring = ring;
   log->bfree = pagesize;
-  log->btip = chPoolAlloc(&log->mempool);
+  log->btip = alloc_buffer(log);
+  log->bnext = NULL;
+  log->reserved = 0;
 
-  log->worker = chThdCreateStatic(NandWorkerThreadWA, sizeof(NandWorkerThreadWA),
-                                  NORMALPRIO, NandWorker, log);
+  log->worker = chThdCreateStatic(config->worker_wa, config->worker_wa_size,
+                                  config->worker_prio, NandWorker, log);
   osalDbgAssert(NULL != log->worker, "Can not allocate memroy");
   log->state = NAND_LOG_READY;
 }
@@ -164,66 +728,240 @@ void nandLogStart(NandLog *log, NandRing *ring,
 size_t nandLogWrite(NandLog *log, const uint8_t *data, size_t len) {
 
   osalDbgCheck((NULL != log) && (NULL != data) && (0 != len));
-  if (NAND_LOG_NO_SPACE == log->state)
-    return 0;
-  osalDbgCheck(NAND_LOG_READY == log->state);
   size_t written = 0;
+  NandLogSpan span;
+
+  /* whole record goes under single lock, so concurrent producers never
+     interleave inside it unless this one has to wait for free buffer */
+  if (! producer_lock(log))
+    return 0;
   const size_t pds = log->ring->config->nandp->config->page_data_size;
+  while (len > 0) {
+    const size_t chunk = (len < pds) ? len : pds;
+    const size_t got = reserve_locked(log, chunk, &span);
+    if (0 == got)
+      break;
 
-  /* first look for available buffers and try to allocate new one
-     if all of them was exhausted during previouse operation */
-  if (NULL == log->btip) {
-    log->btip = chPoolAlloc(&log->mempool);
-    if (NULL == log->btip) {
-      return 0;
+    memcpy(span.data[0], data, span.len[0]);
+    if (span.len[1] > 0)
+      memcpy(span.data[1], &data[span.len[0]], span.len[1]);
+    commit_locked(log, got);
+
+    data += got;
+    len -= got;
+    written += got;
+    if (got < chunk) {
+      /* memory pool exhausted */
+      break;
     }
   }
 
-  /* write main data block */
-  while (len >= log->bfree) {
-    memcpy(log->btip, data, log->bfree);
+  if (len > 0) {
+    log->dbg.dropped_bytes += len;
+    log->dbg.dropped_writes++;
+  }
+  chMtxUnlock(&log->lock);
+  return written;
+}
 
-    len -= log->bfree;
-    written += log->bfree;
-    log->btip += len;
-    post_full_buffer(log);
+/**
+ * @brief   Append several fragments as single record.
+ * @details Record is written completely or not written at all, so
+ *          it never gets torn by buffer shortage.
+ * @note    Total length must not exceed page data size, longer record
+ *          is dropped.
+ * @return  Size of written record or 0.
+ */
+size_t nandLogWritev(NandLog *log, const NandLogIovec *iov, size_t iovcnt) {
 
-    log->bfree = pds;
-    log->btip  = chPoolAlloc(&log->mempool);
-    if (NULL == log->btip) {
-      /* memory pool exhausted */
-      return written;
-    }
+  osalDbgCheck((NULL != log) && (NULL != iov) && (0 != iovcnt));
+  size_t total = 0;
+
+  for (size_t i=0; i<iovcnt; i++) {
+    total += iov[i].len;
   }
+  if (0 == total)
+    return 0;
 
-  /* write data tail if any */
-  memcpy(log->btip, data, len);
-  log->bfree -= len;
-  log->btip += len;
-  written += len;
+  if (! producer_lock(log))
+    return 0;
+  const size_t ret = append_locked(log, iov, iovcnt, total, false);
+  chMtxUnlock(&log->lock);
+  return ret;
+}
 
-  return written;
+/**
+ * @brief   Append framed record which can be found by
+ *          nandLogReaderNext() starting from any page.
+ * @note    Record and its header must fit in page data size, longer
+ *          record is dropped whole. Do not mix records with unframed
+ *          writes in the same log.
+ * @return  Size of written record body or 0.
+ */
+size_t nandLogWriteRecord(NandLog *log, uint16_t type,
+                          const uint8_t *data, size_t len) {
+
+  osalDbgCheck((NULL != log) && ((NULL != data) || (0 == len)));
+  const NandLogRecord header = {(uint16_t)len, type};
+  const NandLogIovec iov[2] = {
+    {(const uint8_t *)&header, sizeof(header)},
+    {data, len}
+  };
+
+  if (! producer_lock(log))
+    return 0;
+  const size_t ret = append_locked(log, iov, 2, sizeof(header) + len, true);
+  chMtxUnlock(&log->lock);
+
+  if (0 == ret)
+    return 0;
+  return len;
+}
+
+/**
+ * @brief   Reserve room in page buffers so producer can serialize data
+ *          directly in place.
+ * @details Waits for free buffers according to overflow policy.
+ * @note    Successful reservation holds producer lock, so it must be
+ *          published by nandLogCommit() as soon as possible.
+ * @param[in] len     bytes to reserve, not more than page data size
+ * @param[out] span   one or two areas to be filled by producer
+ * @return  Size of actually reserved area. It is less than requested
+ *          when no buffers available.
+ */
+size_t nandLogReserve(NandLog *log, size_t len, NandLogSpan *span) {
+
+  osalDbgCheck((NULL != log) && (NULL != span));
+
+  if (! producer_lock(log)) {
+    span->data[0] = NULL;
+    span->data[1] = NULL;
+    span->len[0]  = 0;
+    span->len[1]  = 0;
+    return 0;
+  }
+  const size_t got = reserve_locked(log, len, span);
+  if (got < len) {
+    log->dbg.dropped_bytes += len - got;
+    log->dbg.dropped_writes++;
+  }
+  if (0 == got)
+    chMtxUnlock(&log->lock);
+
+  return got;
+}
+
+/**
+ * @brief   Publish data placed in area obtained from nandLogReserve().
+ * @param[in] len   bytes actually filled, may be less than reserved
+ */
+void nandLogCommit(NandLog *log, size_t len) {
+
+  osalDbgCheck(NULL != log);
+
+  commit_locked(log, len);
+  chMtxUnlock(&log->lock);
+}
+
+/**
+ * @brief   Seal partially filled page buffer and pass it to worker.
+ * @details Real number of bytes stored in page header, so readers
+ *          ignore the rest of page.
+ */
+void nandLogFlush(NandLog *log) {
+
+  osalDbgCheck(NULL != log);
+
+  chMtxLock(&log->lock);
+  if (NAND_LOG_READY == log->state) {
+    osalDbgCheck(0 == log->reserved);
+    flush_locked(log);
+  }
+  chMtxUnlock(&log->lock);
+}
+
+/**
+ * @brief   Set automatic flush conditions. Zero disables condition.
+ * @param[in] period  maximum time data may wait in RAM
+ * @param[in] size    maximum amount of data waiting in RAM
+ */
+void nandLogSetAutoFlush(NandLog *log, systime_t period, size_t size) {
+
+  osalDbgCheck(NULL != log);
+
+  chMtxLock(&log->lock);
+  log->flush_period = period;
+  log->flush_size = size;
+  chMtxUnlock(&log->lock);
+
+  /* worker may sleep infinitely, let it see new period */
+  if (NULL != log->worker) {
+    chMBPost(&log->mb, MSG_WAKE, TIME_IMMEDIATE);
+  }
+}
+
+/**
+ * @brief   Select what producer does when all buffers are full.
+ * @param[in] timeout   used only by NAND_LOG_OVERFLOW_TIMEOUT policy
+ */
+void nandLogSetOverflow(NandLog *log, nand_log_overflow_t policy,
+                        systime_t timeout) {
+
+  osalDbgCheck(NULL != log);
+
+  chMtxLock(&log->lock);
+  log->overflow = policy;
+  log->overflow_timeout = timeout;
+  chMtxUnlock(&log->lock);
 }
 
 /**
  * @brief nandLogStop
  * @param log
+ * @note    Producers calling after stop get 0. Producers waiting for
+ *          free buffer wake up when worker drains the pool and get 0
+ *          too, log memory must not be released before they return.
  */
 void nandLogStop(NandLog *log) {
 
-  if ((NAND_LOG_READY == log->state) || (NAND_LOG_NO_SPACE == log->state)) {
-    log->state = NAND_LOG_STOP;
+  /* state changes under producer lock, so no producer is inside
+     reservation when stop begins */
+  chMtxLock(&log->lock);
+  if (NAND_LOG_STOP == log->state) {
+    chMtxUnlock(&log->lock);
+    return;
+  }
+  log->state = NAND_LOG_STOP;
 
-    zero_tail(log);
-    post_full_buffer(log);
+  /* seal data tail, buffer left empty goes back to pool */
+  flush_locked(log);
+  if (NULL != log->btip) {
+    free_buffer(log, log->btip);
+    log->btip = NULL;
+  }
+  chMtxUnlock(&log->lock);
 
-    chThdTerminate(log->worker);
-    chThdWait(log->worker);
-    log->worker = NULL;
+  /* stop request goes after all buffers, so they get written first */
+  chMBPost(&log->mb, MSG_STOP, TIME_INFINITE);
+  chThdWait(log->worker);
+  log->worker = NULL;
 
-    nandRingStop(log->ring);
-    log->ring = NULL;
+  chMtxLock(&log->lock);
+  if (NULL != log->bnext) {
+    free_buffer(log, log->bnext);
+    log->bnext = NULL;
   }
+  log->reserved = 0;
+  NandRing *ring = log->ring;
+  log->ring = NULL;
+  chMtxUnlock(&log->lock);
+
+  /* readers in other threads may use the same NAND right now */
+  NANDDriver *nandp = ring->config->nandp;
+  nandAcquireBus(nandp);
+  nandRingUmount(ring);
+  nandRingStop(ring);
+  nandReleaseBus(nandp);
 }
 
 /**
@@ -234,3 +972,130 @@ void nandLogErase(NandLog *log) {
   osalDbgCheck(NAND_LOG_STOP == log->state);
   nandRingErase(log->ring);
 }
+
+/**
+ * @brief   Count framed records starting in page into block summary.
+ * @details Set it as summary_cb of ring config. Record header never
+ *          crosses page boundary and the next page points to the record
+ *          following the continued one, so every record is counted once.
+ */
+void nandLogSummaryRecords(NandBlockSummary *summary, const uint8_t *data,
+                           const NandPageHeader *header) {
+
+  NandLogRecord record;
+  size_t pos = header->first_record;
+
+  if (NAND_RING_NO_RECORD == pos)
+    return;
+
+  while (pos + sizeof(NandLogRecord) <= header->written) {
+    memcpy(&record, &data[pos], sizeof(NandLogRecord));
+    const size_t type = (record.type < NAND_RING_SUMMARY_TYPES) ?
+                         record.type : (NAND_RING_SUMMARY_TYPES - 1);
+    summary->records++;
+    summary->types[type]++;
+    pos += sizeof(NandLogRecord) + record.len;
+  }
+}
+
+/**
+ * @brief   Prepare reader to start at any page of ring.
+ * @param[in] pagebuf   buffer of page data size
+ */
+void nandLogReaderStart(NandLogReader *reader, NandRing *ring,
+                        uint8_t *pagebuf, uint32_t blk, uint32_t page) {
+
+  osalDbgCheck((NULL != reader) && (NULL != ring) && (NULL != pagebuf));
+
+  reader->ring = ring;
+  reader->buf = pagebuf;
+  reader->blk = blk;
+  reader->page = page;
+  reader->id = 0;
+  reader->written = 0;
+  reader->first = NAND_RING_NO_RECORD;
+  reader->pos = 0;
+  reader->loaded = false;
+  reader->consecutive = false;
+  reader->synced = false;
+  reader->torn = 0;
+}
+
+/**
+ * @brief   Read next record.
+ * @details Record body longer than max gets truncated, its full length
+ *          is still reported in record header.
+ * @param[out] record   header of returned record
+ * @param[out] data     buffer for record body
+ * @return  False when there is no more valid data.
+ */
+bool nandLogReaderNext(NandLogReader *reader, NandLogRecord *record,
+                       uint8_t *data, size_t max) {
+
+  osalDbgCheck((NULL != reader) && (NULL != record) && ((NULL != data) || (0 == max)));
+
+  if (! reader->loaded) {
+    if (! reader_load(reader))
+      return false;
+  }
+
+  while (true) {
+    if (! reader->synced) {
+      /* page has no record start, so it holds continuation only */
+      if ((NAND_RING_NO_RECORD == reader->first) || (reader->first >= reader->written)) {
+        if (! reader_advance(reader))
+          return false;
+        continue;
+      }
+      reader->pos = reader->first;
+      reader->synced = true;
+    }
+
+    if (reader->pos == reader->written) {
+      if (! reader_advance(reader))
+        return false;
+      /* previous page ended at record boundary, so this one must start
+         with record */
+      if ((! reader->consecutive) || (0 != reader->first))
+        reader->synced = false;
+      continue;
+    }
+
+    if ((reader->written - reader->pos) < sizeof(NandLogRecord)) {
+      reader_resync(reader);
+      if (! reader_advance(reader))
+        return false;
+      continue;
+    }
+
+    memcpy(record, &reader->buf[reader->pos], sizeof(NandLogRecord));
+    reader->pos += sizeof(NandLogRecord);
+
+    /* body may continue in the following pages */
+    size_t left = record->len;
+    size_t got = 0;
+    while (left > 0) {
+      if (reader->pos == reader->written) {
+        if (! reader_advance(reader))
+          return false;
+        const size_t cont = (NAND_RING_NO_RECORD == reader->first) ?
+                             reader->written : reader->first;
+        if ((! reader->consecutive) || (left > cont))
+          break;
+      }
+      const size_t avail = reader->written - reader->pos;
+      const size_t n = (left < avail) ? left : avail;
+      if (got < max) {
+        const size_t c = ((max - got) < n) ? (max - got) : n;
+        memcpy(&data[got], &reader->buf[reader->pos], c);
+        got += c;
+      }
+      reader->pos += n;
+      left -= n;
+    }
+
+    if (0 == left)
+      return true;
+    reader_resync(reader);
+  }
+}
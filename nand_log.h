@@ -3,7 +3,15 @@
 
 #include "nand_ring.h"
 
-#define NAND_BUFFER_COUNT       3
+/**
+ * @brief   Maximum number of buffers written by worker in single call.
+ */
+#define NAND_LOG_BATCH_MAX      8
+
+/**
+ * @brief   Stack size for worker working area supplied in NandLogConfig.
+ */
+#define NAND_LOG_WORKER_STACK   512
 
 typedef enum {
   NAND_LOG_UNINIT,
@@ -12,21 +20,188 @@ typedef enum {
   NAND_LOG_STOP
 } nand_log_state_t;
 
+/**
+ * @brief   What producer does when all page buffers are full.
+ */
+typedef enum {
+  /* return short count, new data lost */
+  NAND_LOG_OVERFLOW_DROP_NEWEST = 0,
+  /* wait until worker frees buffer */
+  NAND_LOG_OVERFLOW_BLOCK,
+  /* wait limited time, then drop new data */
+  NAND_LOG_OVERFLOW_TIMEOUT,
+  /* reuse the oldest buffer not yet taken by worker, its data lost */
+  NAND_LOG_OVERFLOW_DROP_OLDEST
+} nand_log_overflow_t;
+
+/**
+ *
+ */
+typedef struct {
+  /* data lost because of buffer overflow */
+  uint32_t    dropped_bytes;
+  /* write calls which lost data */
+  uint32_t    dropped_writes;
+  /* buffers discarded by drop oldest policy */
+  uint32_t    dropped_pages;
+  /* time producers spent waiting for free buffer */
+  uint32_t    blocked_us;
+  uint32_t    blocked_max_us;
+  /* maximum number of buffers in use at once */
+  uint32_t    high_water;
+  /* throughput: data accepted from producers, data and pages programmed
+     by worker and time worker spent programming them */
+  uint32_t    committed_bytes;
+  uint32_t    bytes_written;
+  uint32_t    pages_written;
+  uint32_t    write_us;
+  /* producer found lock held by another producer */
+  uint32_t    lock_contended;
+  /* time worker waited for NAND bus held by readers or other logs */
+  uint32_t    bus_wait_us;
+  uint32_t    bus_wait_max_us;
+} nand_log_debug_t;
+
+/**
+ * @brief   Producer window into page buffers returned by nandLogReserve().
+ * @details Second span is used only when reserved area crosses
+ *          page boundary.
+ */
+typedef struct {
+  uint8_t           *data[2];
+  size_t            len[2];
+} NandLogSpan;
+
+/**
+ * @brief   Single fragment of record passed to nandLogWritev().
+ */
+typedef struct {
+  const uint8_t     *data;
+  size_t            len;
+} NandLogIovec;
+
+/**
+ * @brief   Header of framed record written by nandLogWriteRecord().
+ * @details Header never crosses page boundary, record body may continue
+ *          in the next page.
+ */
+typedef struct __attribute__((packed)) {
+  /* body length not including this header */
+  uint16_t          len;
+  /* application defined record type */
+  uint16_t          type;
+} NandLogRecord;
+
+/**
+ * @brief   Sequential reader of framed records.
+ * @details Can be started at any page, it synchronizes to the first
+ *          record start stored in page header.
+ */
+typedef struct {
+  NandRing          *ring;
+  /* page data buffer supplied by caller */
+  uint8_t           *buf;
+  uint32_t          blk;
+  uint32_t          page;
+  uint64_t          id;
+  /* header fields of currently loaded page */
+  uint16_t          written;
+  uint16_t          first;
+  /* parsing position inside loaded page */
+  size_t            pos;
+  bool              loaded;
+  /* loaded page immediately follows previous one */
+  bool              consecutive;
+  bool              synced;
+  /* records cut by missing or broken pages */
+  uint32_t          torn;
+} NandLogReader;
+
+/**
+ * @brief   Staging memory and initial policies of log.
+ */
+typedef struct {
+  /**
+   * @brief   Memory for page buffers and worker queue.
+   * @details Size must be at least nandLogArenaSize() bytes, word aligned.
+   */
+  uint8_t             *arena;
+  /**
+   * @brief   Number of page buffers, i.e. how many pages can wait
+   *          in RAM for programming.
+   */
+  size_t              depth;
+  nand_log_overflow_t overflow;
+  systime_t           overflow_timeout;
+  /**
+   * @brief   Auto flush conditions, zero means disabled.
+   */
+  systime_t           flush_period;
+  size_t              flush_size;
+  /**
+   * @brief   Worker thread working area, every log needs its own one.
+   * @details Declare it using THD_WORKING_AREA(wa, NAND_LOG_WORKER_STACK).
+   */
+  void                *worker_wa;
+  size_t              worker_wa_size;
+  tprio_t             worker_prio;
+} NandLogConfig;
+
 /**
  *
  */
 typedef struct {
   NandRing          *ring;
+  const NandLogConfig *config;
   thread_t          *worker;
   nand_log_state_t  state;
 
   mailbox_t         mb;
-  msg_t             mailbox_buf[NAND_BUFFER_COUNT];
+  /**
+   * @brief   Bytes of data in posted buffers, indexed by pool position.
+   */
+  uint16_t          *blen;
+  /**
+   * @brief   Offset of the first record starting in buffer, indexed by
+   *          pool position.
+   */
+  uint16_t          *bfirst;
+
+  /**
+   * @brief   Guards producer side buffer state.
+   */
+  mutex_t           lock;
 
   size_t            bfree;
   uint8_t           *btip;
+  /**
+   * @brief   Buffer allocated for the second span of reservation.
+   */
+  uint8_t           *bnext;
+  /**
+   * @brief   Bytes reserved but not committed yet.
+   */
+  size_t            reserved;
+  /**
+   * @brief   Time when current buffer got its first byte.
+   */
+  systime_t         bstamp;
   memory_pool_t     mempool;
+  /**
+   * @brief   Counts free buffers in pool, producers wait on it.
+   */
+  semaphore_t       free_sem;
   uint8_t           *mempool_buf;
+
+  /**
+   * @brief   Auto flush conditions, zero means disabled.
+   */
+  systime_t         flush_period;
+  size_t            flush_size;
+
+  nand_log_overflow_t overflow;
+  systime_t         overflow_timeout;
+  nand_log_debug_t  dbg;
 } NandLog;
 
 
@@ -34,12 +209,28 @@ typedef struct {
 extern "C" {
 #endif
   void nandLogObjectInit(NandLog *log);
-  void nandLogStart(NandLog *log, NandRing *ring,
+  size_t nandLogArenaSize(const NANDDriver *nandp, size_t depth);
+  void nandLogStart(NandLog *log, const NandLogConfig *config, NandRing *ring,
                     const NandRingConfig *nandringcfg,
                     uint8_t *ring_working_area);
   size_t nandLogWrite(NandLog *log, const uint8_t *data, size_t len);
+  size_t nandLogWritev(NandLog *log, const NandLogIovec *iov, size_t iovcnt);
+  size_t nandLogWriteRecord(NandLog *log, uint16_t type,
+                            const uint8_t *data, size_t len);
+  size_t nandLogReserve(NandLog *log, size_t len, NandLogSpan *span);
+  void nandLogCommit(NandLog *log, size_t len);
+  void nandLogFlush(NandLog *log);
+  void nandLogSetAutoFlush(NandLog *log, systime_t period, size_t size);
+  void nandLogSetOverflow(NandLog *log, nand_log_overflow_t policy,
+                          systime_t timeout);
   void nandLogErase(NandLog *log);
   void nandLogStop(NandLog *log);
+  void nandLogSummaryRecords(NandBlockSummary *summary, const uint8_t *data,
+                             const NandPageHeader *header);
+  void nandLogReaderStart(NandLogReader *reader, NandRing *ring,
+                          uint8_t *pagebuf, uint32_t blk, uint32_t page);
+  bool nandLogReaderNext(NandLogReader *reader, NandLogRecord *record,
+                         uint8_t *data, size_t max);
 #ifdef __cplusplus
 }
 #endif
@@ -57,7 +248,7 @@ public:
 private:
   THD_WORKING_AREA(NandWorkerThreadWA, 320);
   static THD_FUNCTION(WorkerThread, arg);
-  MultiBufferAccumulator<2048, NAND_BUFFER_COUNT> multibuf; //FIXME: remove hardcoded sizes
+  MultiBufferAccumulator<2048, 3> multibuf; //FIXME: remove hardcoded sizes
   chibios_rt::Mailbox<uint8_t*, NAND_BUFFER_COUNT> mailbox;
   bool ready;
   NandRing *ring;
@@ -16,6 +16,15 @@
 
 #define NAND_TEST_START_BLOCK     (4096)
 #define NAND_TEST_LEN             128
+#define AUTO_FLUSH_PERIOD_MS      10
+#define NAND_LOG_DEPTH            3
+#define NAND_LOG_DEEP_DEPTH       32
+#define NAND_TEST2_START_BLOCK    (NAND_TEST_START_BLOCK + NAND_TEST_LEN)
+#define NAND_TEST2_LEN            64
+#define NAND_LOG_PRODUCERS        3
+#define PRODUCER_MSGS             500
+#define RECORD_COUNT              3000
+#define RECORD_RESYNC_PAGE        7
 
 /*
  ******************************************************************************
@@ -38,17 +47,89 @@
 static NandRingConfig nandringcfg = {
   NAND_TEST_START_BLOCK,
   NAND_TEST_LEN,
-  NULL
+  NULL,
+  NAND_RING_MOUNT_SEARCH,
+  NAND_RING_WRITE_WHOLE,
+  0,
+  0,
+  0,
+  2
+};
+
+static NandRingConfig nandringcfg2 = {
+  NAND_TEST2_START_BLOCK,
+  NAND_TEST2_LEN,
+  NULL,
+  NAND_RING_MOUNT_SEARCH,
+  NAND_RING_WRITE_SPLIT,
+  0,
+  0,
+  0,
+  0
 };
 
 static NandRing nandring;
 
+static NandRing nandring2;
+
+static THD_WORKING_AREA(NandLogWA, NAND_LOG_WORKER_STACK);
+
+static THD_WORKING_AREA(NandLog2WA, NAND_LOG_WORKER_STACK);
+
 static NandLog nandlog;
 
+static NandLog nandlog2;
+
+static NandLogConfig nandlogcfg = {
+  NULL,
+  NAND_LOG_DEPTH,
+  NAND_LOG_OVERFLOW_DROP_NEWEST,
+  TIME_IMMEDIATE,
+  0,
+  0,
+  NandLogWA,
+  sizeof(NandLogWA),
+  NORMALPRIO
+};
+
+static NandLogConfig nandlogcfg2 = {
+  NULL,
+  NAND_LOG_DEPTH,
+  NAND_LOG_OVERFLOW_DROP_NEWEST,
+  TIME_IMMEDIATE,
+  0,
+  0,
+  NandLog2WA,
+  sizeof(NandLog2WA),
+  NORMALPRIO
+};
+
 static LinetestParser line_parser;
 
+static LinetestParser line_parser2;
+
+static LinetestParser verify_parser;
+
+static THD_WORKING_AREA(ProducerWA[NAND_LOG_PRODUCERS], 512);
+
+static THD_WORKING_AREA(ReaderWA, 1024);
+
+typedef struct {
+  NandRing        *ring;
+  uint32_t        first_blk;
+  size_t          max;
+  uint8_t         *pagebuf;
+  uint8_t         *body;
+  uint8_t         *expected;
+  volatile bool   stop;
+} TestReader;
+
+static LinetestParser producer_parser[NAND_LOG_PRODUCERS];
+
 static uint32_t WrittenBytesTotal = 0;
 
+static uint32_t WrittenMsgTotal = 0;
+
 /*
  ******************************************************************************
  ******************************************************************************
@@ -63,12 +144,604 @@ static uint32_t WrittenBytesTotal = 0;
  */
 void write_block_test(NandLog *nandlog) {
   size_t N = 100;
+  const size_t len = N + LINETEST_OVERHEAD;
+
+  const uint8_t *data = LinetestParserFill(&line_parser, N);
+  size_t wr = nandLogWrite(nandlog, data, len);
+  osalDbgCheck (len == wr);
+  WrittenBytesTotal += len;
+  WrittenMsgTotal++;
+  osalThreadSleepMilliseconds(2);
+}
+
+/**
+ * @brief   Serialize message straight into page buffers.
+ * @details Reserves more than needed to check partial commit.
+ */
+void reserve_commit_test(NandLog *nandlog) {
+  const size_t N = 1 + rand() % 300;
+  const size_t len = N + LINETEST_OVERHEAD;
+  NandLogSpan span;
 
   const uint8_t *data = LinetestParserFill(&line_parser, N);
-  size_t wr = nandLogWrite(nandlog, data, N);
-  osalDbgCheck (N == wr);
-  WrittenBytesTotal += N;
-  osalThreadSleepMilliseconds(20);
+  size_t got = nandLogReserve(nandlog, len + 16, &span);
+  osalDbgCheck(len + 16 == got);
+  osalDbgCheck(got == span.len[0] + span.len[1]);
+  if (span.len[0] >= len) {
+    memcpy(span.data[0], data, len);
+  }
+  else {
+    memcpy(span.data[0], data, span.len[0]);
+    memcpy(span.data[1], &data[span.len[0]], len - span.len[0]);
+  }
+  nandLogCommit(nandlog, len);
+  WrittenBytesTotal += len;
+  WrittenMsgTotal++;
+  osalThreadSleepMilliseconds(2);
+}
+
+/**
+ * @brief   Write message as separate header, payload and checksum.
+ */
+void writev_test(NandLog *nandlog) {
+  const size_t N = rand() % 300;
+  const size_t len = N + LINETEST_OVERHEAD;
+  NandLogIovec iov[3];
+
+  const uint8_t *data = LinetestParserFill(&line_parser, N);
+  iov[0].data = data;
+  iov[0].len  = LINETEST_HEADER_LEN;
+  iov[1].data = &data[LINETEST_HEADER_LEN];
+  iov[1].len  = N;
+  iov[2].data = &data[LINETEST_HEADER_LEN + N];
+  iov[2].len  = LINETEST_CHECKSUM_LEN;
+  osalDbgCheck(len == nandLogWritev(nandlog, iov, 3));
+  WrittenBytesTotal += len;
+  WrittenMsgTotal++;
+  osalThreadSleepMilliseconds(2);
+}
+
+/**
+ * @brief   Explicit flush must put data on NAND right now.
+ */
+void flush_test(NandLog *nandlog, NandRing *ring) {
+  const size_t N = rand() % 300;
+  const size_t len = N + LINETEST_OVERHEAD;
+
+  const uint8_t *data = LinetestParserFill(&line_parser, N);
+  osalDbgCheck(len == nandLogWrite(nandlog, data, len));
+  WrittenBytesTotal += len;
+  WrittenMsgTotal++;
+
+  const uint64_t id = ring->cur_id;
+  nandLogFlush(nandlog);
+  for (size_t i=0; (i<100) && (id == ring->cur_id); i++) {
+    osalThreadSleepMilliseconds(1);
+  }
+  osalDbgCheck(id < ring->cur_id);
+}
+
+/**
+ * @brief   Data must reach NAND within flush period without any
+ *          further producer activity.
+ */
+void auto_flush_test(NandLog *nandlog, NandRing *ring) {
+  const size_t N = rand() % 300;
+  const size_t len = N + LINETEST_OVERHEAD;
+
+  const uint8_t *data = LinetestParserFill(&line_parser, N);
+  osalDbgCheck(len == nandLogWrite(nandlog, data, len));
+  WrittenBytesTotal += len;
+  WrittenMsgTotal++;
+
+  const uint64_t id = ring->cur_id;
+  for (size_t i=0; (i<10 * AUTO_FLUSH_PERIOD_MS) && (id == ring->cur_id); i++) {
+    osalThreadSleepMilliseconds(1);
+  }
+  osalDbgCheck(id < ring->cur_id);
+}
+
+/**
+ * @brief   Read session back from NAND and parse it.
+ */
+static void verify_session(NANDDriver *nandp, const NandRingConfig *cfg,
+                           uint32_t first_blk, uint32_t last_blk,
+                           uint32_t last_page, uint32_t msgs) {
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandPageHeader header;
+  uint32_t ecc;
+
+  LinetestParserObjectInit(&verify_parser);
+  uint32_t blk = first_blk;
+  size_t page = 0;
+  while ((blk != last_blk) || (page != last_page)) {
+    nandReadPageData(nandp, blk, page, pagebuf, pds, &ecc);
+    nandReadPageSpare(nandp, blk, page, (uint8_t *)&header, sizeof(header));
+    osalDbgCheck(header.written <= pds);
+    for (size_t i=0; i<header.written; i++) {
+      LinetestParserCollect(&verify_parser, pagebuf[i]);
+    }
+    page++;
+    if (ppb == page) {
+      page = 0;
+      do {
+        blk++;
+        if (blk == cfg->start_blk + cfg->len)
+          blk = cfg->start_blk;
+      } while (nandIsBad(nandp, blk));
+    }
+  }
+
+  osalDbgCheck(0 == verify_parser.dbg.bad_checksum);
+  osalDbgCheck(msgs == verify_parser.dbg.recvd_msgs);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Write burst much bigger than buffer pool without any pause.
+ * @details Lost bytes must be accounted exactly, blocking policies
+ *          must not lose anything.
+ */
+static void overflow_test(NandLog *nandlog, nand_log_overflow_t policy) {
+  const size_t chunk = 500;
+  const size_t total = 200 * chunk;
+  uint8_t *buf = chHeapAlloc(NULL, chunk);
+  size_t written = 0;
+
+  memset(buf, 0x5A, chunk);
+  nandLogSetOverflow(nandlog, policy, MS2ST(1));
+  const uint32_t dropped = nandlog->dbg.dropped_bytes;
+  for (size_t i=0; i<total; i+=chunk) {
+    written += nandLogWrite(nandlog, buf, chunk);
+  }
+  const uint32_t lost = nandlog->dbg.dropped_bytes - dropped;
+
+  switch (policy) {
+  case NAND_LOG_OVERFLOW_BLOCK:
+    osalDbgCheck((total == written) && (0 == lost));
+    break;
+  case NAND_LOG_OVERFLOW_DROP_OLDEST:
+    /* lost data was already accepted by previous writes */
+    osalDbgCheck(total == written);
+    break;
+  default:
+    osalDbgCheck(total == written + lost);
+    break;
+  }
+  osalDbgCheck(nandlog->dbg.blocked_max_us <= nandlog->dbg.blocked_us);
+  osalDbgCheck(nandlog->dbg.bus_wait_max_us <= nandlog->dbg.bus_wait_us);
+
+  nandLogSetOverflow(nandlog, NAND_LOG_OVERFLOW_DROP_NEWEST, 0);
+  chHeapFree(buf);
+}
+
+/**
+ * @brief   Producer writing burst much bigger than buffer pool.
+ */
+static THD_FUNCTION(BurstProducerThread, arg) {
+  NandLog *log = arg;
+  const size_t pds = log->ring->config->nandp->config->page_data_size;
+  const size_t len = pds * (log->config->depth + 2);
+  uint8_t *buf = chHeapAlloc(NULL, len);
+
+  memset(buf, 0xA5, len);
+  const size_t written = nandLogWrite(log, buf, len);
+  chHeapFree(buf);
+  chThdExit((msg_t)written);
+}
+
+/**
+ * @brief   Stops log from separate thread while test holds NAND bus.
+ */
+static THD_FUNCTION(StopperThread, arg) {
+  nandLogStop(arg);
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Start producer and hold NAND bus until it waits for buffer.
+ * @details Bus is held by test, so worker can not free any buffer
+ *          until test releases it.
+ */
+static thread_t *start_blocked_producer(NandLog *nandlog) {
+  NANDDriver *nandp = nandlog->ring->config->nandp;
+
+  nandLogSetOverflow(nandlog, NAND_LOG_OVERFLOW_BLOCK, 0);
+
+  /* let worker return buffers left by previous test */
+  nandLogFlush(nandlog);
+  while ((size_t)chSemGetCounterI(&nandlog->free_sem) + (NULL != nandlog->btip)
+         + (NULL != nandlog->bnext) < nandlog->config->depth) {
+    chThdSleepMilliseconds(1);
+  }
+
+  nandAcquireBus(nandp);
+  thread_t *producer = chThdCreateStatic(ProducerWA[0], sizeof(ProducerWA[0]),
+                         NORMALPRIO, BurstProducerThread, nandlog);
+  /* last buffer is taken by producer under its lock */
+  while (chSemGetCounterI(&nandlog->free_sem) > 0) {
+    chThdSleepMilliseconds(1);
+  }
+  return producer;
+}
+
+/**
+ * @brief   Producer waiting for free buffer must not keep other
+ *          producers out.
+ */
+static void blocked_producer_test(NandLog *nandlog) {
+  NANDDriver *nandp = nandlog->ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  bool locked = false;
+
+  const uint32_t dropped = nandlog->dbg.dropped_bytes;
+  thread_t *producer = start_blocked_producer(nandlog);
+  for (size_t i=0; (i<100) && (! locked); i++) {
+    locked = chMtxTryLock(&nandlog->lock);
+    if (! locked)
+      chThdSleepMilliseconds(1);
+  }
+  osalDbgCheck(locked);
+  chMtxUnlock(&nandlog->lock);
+  nandReleaseBus(nandp);
+
+  osalDbgCheck(pds * (nandlog->config->depth + 2) == (size_t)chThdWait(producer));
+  osalDbgCheck(dropped == nandlog->dbg.dropped_bytes);
+  osalDbgCheck(nandlog->dbg.blocked_us > 0);
+  nandLogSetOverflow(nandlog, NAND_LOG_OVERFLOW_DROP_NEWEST, 0);
+}
+
+/**
+ * @brief   Stop must get through while producer waits for buffer,
+ *          producer gives up and later writes are refused.
+ */
+static void stop_blocked_producer_test(NandLog *nandlog) {
+  NANDDriver *nandp = nandlog->ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t len = pds * (nandlog->config->depth + 2);
+  uint8_t data[16];
+
+  thread_t *producer = start_blocked_producer(nandlog);
+  thread_t *stopper = chThdCreateStatic(ProducerWA[1], sizeof(ProducerWA[1]),
+                        NORMALPRIO, StopperThread, nandlog);
+  while (NAND_LOG_STOP != nandlog->state) {
+    chThdSleepMilliseconds(1);
+  }
+  nandReleaseBus(nandp);
+
+  chThdWait(stopper);
+  osalDbgCheck(len > (size_t)chThdWait(producer));
+  osalDbgCheck(NULL == nandlog->ring);
+
+  memset(data, 0, sizeof(data));
+  osalDbgCheck(0 == nandLogWrite(nandlog, data, sizeof(data)));
+  osalDbgCheck(0 == nandLogWriteRecord(nandlog, 1, data, sizeof(data)));
+}
+
+/**
+ * @brief   Producer thread for concurrent append test.
+ */
+static THD_FUNCTION(ProducerThread, arg) {
+  LinetestParser *parser = arg;
+
+  for (size_t i=0; i<PRODUCER_MSGS; i++) {
+    const size_t N = 16 + (i * 37) % 300;
+    const uint8_t *data = LinetestParserFill(parser, N);
+    osalDbgCheck(N + LINETEST_OVERHEAD == nandLogWrite(&nandlog, data, N + LINETEST_OVERHEAD));
+    if (0 == i % 16)
+      chThdYield();
+  }
+
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Several threads append to the same log at once.
+ * @details Records must land in NAND whole, order between producers
+ *          does not matter.
+ */
+static void producers_test(NANDDriver *nandp, uint8_t *ring_wa) {
+  thread_t *producer[NAND_LOG_PRODUCERS];
+
+  nandlogcfg.depth = NAND_LOG_DEPTH;
+  nandlogcfg.overflow = NAND_LOG_OVERFLOW_BLOCK;
+  nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+  nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_wa);
+  const uint32_t first_blk = nandring.cur_blk;
+
+  for (size_t i=0; i<NAND_LOG_PRODUCERS; i++) {
+    LinetestParserObjectInit(&producer_parser[i]);
+    producer[i] = chThdCreateStatic(ProducerWA[i], sizeof(ProducerWA[i]),
+                       NORMALPRIO, ProducerThread, &producer_parser[i]);
+  }
+  for (size_t i=0; i<NAND_LOG_PRODUCERS; i++) {
+    chThdWait(producer[i]);
+  }
+
+  nandLogStop(&nandlog);
+  verify_session(nandp, &nandringcfg, first_blk, nandring.cur_blk,
+                 nandring.cur_page, NAND_LOG_PRODUCERS * PRODUCER_MSGS);
+  osalDbgCheck(0 == nandlog.dbg.dropped_bytes);
+  osalDbgCheck(nandlog.dbg.committed_bytes == nandlog.dbg.bytes_written);
+
+  nandlogcfg.overflow = NAND_LOG_OVERFLOW_DROP_NEWEST;
+  chHeapFree(nandlogcfg.arena);
+}
+
+/**
+ * @brief   Record body is its sequence number followed by counting bytes.
+ */
+static void fill_record(uint8_t *buf, uint32_t seq, size_t len) {
+
+  memcpy(buf, &seq, sizeof(seq));
+  for (size_t i=sizeof(seq); i<len; i++) {
+    buf[i] = seq + i;
+  }
+}
+
+/**
+ * @brief   Read records until end of session checking their sequence.
+ * @return  Sequence number of the first record found.
+ */
+static uint32_t read_records(NandLogReader *reader, uint8_t *body,
+                             uint8_t *expected, size_t max) {
+  NandLogRecord rec;
+  uint32_t first = 0;
+  uint32_t seq;
+  size_t n = 0;
+
+  while (nandLogReaderNext(reader, &rec, body, max)) {
+    osalDbgCheck((rec.len >= sizeof(seq)) && (rec.len <= max));
+    memcpy(&seq, body, sizeof(seq));
+    if (0 == n)
+      first = seq;
+    osalDbgCheck(first + n == seq);
+    osalDbgCheck((seq & 0xFFFF) == rec.type);
+    fill_record(expected, seq, rec.len);
+    osalDbgCheck(0 == memcmp(expected, body, rec.len));
+    n++;
+  }
+
+  osalDbgCheck(0 == reader->torn);
+  osalDbgCheck(first + n == RECORD_COUNT);
+  return first;
+}
+
+/**
+ * @brief   Count records of session from block summaries, the last block
+ *          without summary is scanned page by page.
+ * @return  Number of blocks with summary.
+ */
+static size_t count_records(NandRing *ring, uint8_t *pagebuf,
+                            uint32_t blk, NandBlockSummary *total) {
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  NandBlockSummary summary;
+  NandPageHeader header;
+  uint32_t page = 0;
+  size_t n = 0;
+
+  memset(total, 0, sizeof(NandBlockSummary));
+  while (OSAL_SUCCESS == nandRingBlockSummary(ring, blk, &summary)) {
+    total->records += summary.records;
+    for (size_t i=0; i<NAND_RING_SUMMARY_TYPES; i++)
+      total->types[i] += summary.types[i];
+    page = ppb - 1;
+    nandRingNextPage(ring, &blk, &page);
+    n++;
+  }
+  while (NAND_RING_READ_NO_DATA != nandRingReadPage(ring, blk, page, pagebuf, &header)) {
+    nandLogSummaryRecords(total, pagebuf, &header);
+    nandRingNextPage(ring, &blk, &page);
+  }
+
+  return n;
+}
+
+/**
+ * @brief   Framed records must be found both from session start and
+ *          from arbitrary page in the middle of it. In summary mode
+ *          blocks must count all records.
+ */
+static void record_test(NANDDriver *nandp, uint8_t *ring_wa, bool summary) {
+  const size_t pds = nandp->config->page_data_size;
+  const size_t max = pds - sizeof(NandLogRecord);
+  uint8_t *body = chHeapAlloc(NULL, max);
+  uint8_t *expected = chHeapAlloc(NULL, max);
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandLogReader reader;
+  NandBlockSummary total;
+
+  nandringcfg.block_summary = summary;
+  nandringcfg.summary_cb = summary ? nandLogSummaryRecords : NULL;
+  nandlogcfg.depth = NAND_LOG_DEPTH;
+  nandlogcfg.overflow = NAND_LOG_OVERFLOW_BLOCK;
+  nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+  nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_wa);
+  const uint32_t first_blk = nandring.cur_blk;
+
+  for (uint32_t seq=0; seq<RECORD_COUNT; seq++) {
+    size_t len = sizeof(seq) + rand() % 600;
+    if (0 == seq % 50)
+      len = sizeof(seq) + rand() % (max - sizeof(seq) + 1);
+    fill_record(body, seq, len);
+    osalDbgCheck(len == nandLogWriteRecord(&nandlog, seq & 0xFFFF, body, len));
+    /* partially filled pages */
+    if (0 == seq % 97)
+      nandLogFlush(&nandlog);
+  }
+
+  /* oversize records are dropped whole in any build, length wrapping
+     around 16 bits must not sneak in either */
+  const uint32_t dropped = nandlog.dbg.dropped_writes;
+  osalDbgCheck(0 == nandLogWriteRecord(&nandlog, 0, body, max + 1));
+  osalDbgCheck(0 == nandLogWriteRecord(&nandlog, 0, body, max + 0x10000));
+  const NandLogIovec iov[2] = {{body, max}, {body, sizeof(NandLogRecord) + 1}};
+  osalDbgCheck(0 == nandLogWritev(&nandlog, iov, 2));
+  osalDbgCheck(dropped + 3 == nandlog.dbg.dropped_writes);
+  nandLogStop(&nandlog);
+
+  /* full session */
+  nandRingStart(&nandring, &nandringcfg, ring_wa);
+  nandLogReaderStart(&reader, &nandring, pagebuf, first_blk, 0);
+  osalDbgCheck(0 == read_records(&reader, body, expected, max));
+
+  /* reader starting in the middle picks up at the first whole record */
+  nandLogReaderStart(&reader, &nandring, pagebuf, first_blk, RECORD_RESYNC_PAGE);
+  osalDbgCheck(0 < read_records(&reader, body, expected, max));
+
+  if (summary) {
+    osalDbgCheck(0 < count_records(&nandring, pagebuf, first_blk, &total));
+    osalDbgCheck(RECORD_COUNT == total.records);
+    for (size_t i=0; i<NAND_RING_SUMMARY_TYPES-1; i++)
+      osalDbgCheck(1 == total.types[i]);
+    osalDbgCheck(RECORD_COUNT - NAND_RING_SUMMARY_TYPES + 1
+                 == total.types[NAND_RING_SUMMARY_TYPES-1]);
+  }
+  nandRingStop(&nandring);
+
+  nandringcfg.block_summary = false;
+  nandringcfg.summary_cb = NULL;
+  nandlogcfg.overflow = NAND_LOG_OVERFLOW_DROP_NEWEST;
+  chHeapFree(nandlogcfg.arena);
+  chHeapFree(pagebuf);
+  chHeapFree(expected);
+  chHeapFree(body);
+}
+
+/**
+ * @brief   Reads session from its start again and again while log
+ *          worker keeps writing it.
+ * @return  Total number of records read.
+ */
+static THD_FUNCTION(ReaderThread, arg) {
+  TestReader *r = arg;
+  NandLogReader reader;
+  NandLogRecord rec;
+  uint32_t seq;
+  msg_t total = 0;
+
+  while (! r->stop) {
+    nandLogReaderStart(&reader, r->ring, r->pagebuf, r->first_blk, 0);
+    uint32_t n = 0;
+    while (nandLogReaderNext(&reader, &rec, r->body, r->max)) {
+      memcpy(&seq, r->body, sizeof(seq));
+      osalDbgCheck((n == seq) && ((seq & 0xFFFF) == rec.type));
+      fill_record(r->expected, seq, rec.len);
+      osalDbgCheck(0 == memcmp(r->expected, r->body, rec.len));
+      n++;
+    }
+    /* unfinished tail looks like end of data, not like torn record */
+    osalDbgCheck(0 == reader.torn);
+    total += n;
+    chThdSleepMilliseconds(1);
+  }
+
+  chThdExit(total);
+}
+
+/**
+ * @brief   Reader may run in other thread while log worker writes the
+ *          same session, ring readers share NAND bus with the worker.
+ */
+static void concurrent_reader_test(NANDDriver *nandp, uint8_t *ring_wa) {
+  const size_t pds = nandp->config->page_data_size;
+  const size_t max = pds - sizeof(NandLogRecord);
+  uint8_t *body = chHeapAlloc(NULL, max);
+  uint8_t *expected = chHeapAlloc(NULL, max);
+  TestReader r = {&nandring, 0, max, chHeapAlloc(NULL, pds),
+                  chHeapAlloc(NULL, max), chHeapAlloc(NULL, max), false};
+  NandLogReader reader;
+  thread_t *thd = NULL;
+
+  nandlogcfg.depth = NAND_LOG_DEPTH;
+  nandlogcfg.overflow = NAND_LOG_OVERFLOW_BLOCK;
+  nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+  nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_wa);
+  r.first_blk = nandring.cur_blk;
+
+  for (uint32_t seq=0; seq<RECORD_COUNT; seq++) {
+    const size_t len = sizeof(seq) + rand() % 600;
+    fill_record(body, seq, len);
+    osalDbgCheck(len == nandLogWriteRecord(&nandlog, seq & 0xFFFF, body, len));
+    if (0 == seq % 97)
+      nandLogFlush(&nandlog);
+    /* session block may hold older data until its first page is written */
+    if ((NULL == thd) && (nandlog.dbg.pages_written > 0)) {
+      thd = chThdCreateStatic(ReaderWA, sizeof(ReaderWA), NORMALPRIO,
+                              ReaderThread, &r);
+    }
+  }
+  osalDbgCheck(NULL != thd);
+  r.stop = true;
+  osalDbgCheck(0 < chThdWait(thd));
+  nandLogStop(&nandlog);
+
+  /* nothing got lost under concurrent reads */
+  nandRingStart(&nandring, &nandringcfg, ring_wa);
+  nandLogReaderStart(&reader, &nandring, r.pagebuf, r.first_blk, 0);
+  osalDbgCheck(0 == read_records(&reader, body, expected, max));
+  nandRingStop(&nandring);
+
+  nandlogcfg.overflow = NAND_LOG_OVERFLOW_DROP_NEWEST;
+  chHeapFree(nandlogcfg.arena);
+  chHeapFree(r.expected);
+  chHeapFree(r.body);
+  chHeapFree(r.pagebuf);
+  chHeapFree(expected);
+  chHeapFree(body);
+}
+
+/**
+ * @brief   Two logs with own workers write to separate rings on the
+ *          same NAND at the same time.
+ */
+static void multiple_logs_test(NANDDriver *nandp, uint8_t *ring_wa,
+                               uint8_t *ring_wa2) {
+  uint32_t msgs = 0;
+  uint32_t msgs2 = 0;
+
+  nandringcfg2.nandp = nandp;
+  nandlogcfg.depth = NAND_LOG_DEPTH;
+  nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+  nandlogcfg2.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg2.depth));
+  LinetestParserObjectInit(&line_parser);
+  LinetestParserObjectInit(&line_parser2);
+
+  nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_wa);
+  nandLogStart(&nandlog2, &nandlogcfg2, &nandring2, &nandringcfg2, ring_wa2);
+  const uint32_t first_blk = nandring.cur_blk;
+  const uint32_t first_blk2 = nandring2.cur_blk;
+
+  /* high rate stream and low rate events */
+  for (size_t i=0; i<2000; i++) {
+    const size_t N = 200 + rand() % 200;
+    const uint8_t *data = LinetestParserFill(&line_parser, N);
+    osalDbgCheck(N + LINETEST_OVERHEAD == nandLogWrite(&nandlog, data, N + LINETEST_OVERHEAD));
+    msgs++;
+    if (0 == i % 8) {
+      data = LinetestParserFill(&line_parser2, 20);
+      osalDbgCheck(20 + LINETEST_OVERHEAD == nandLogWrite(&nandlog2, data, 20 + LINETEST_OVERHEAD));
+      msgs2++;
+    }
+    osalThreadSleepMilliseconds(1);
+  }
+
+  nandLogStop(&nandlog);
+  nandLogStop(&nandlog2);
+  verify_session(nandp, &nandringcfg, first_blk,
+                 nandring.cur_blk, nandring.cur_page, msgs);
+  verify_session(nandp, &nandringcfg2, first_blk2,
+                 nandring2.cur_blk, nandring2.cur_page, msgs2);
+
+  /* nothing lost, so everything accepted reached NAND */
+  osalDbgCheck(nandlog.dbg.committed_bytes == nandlog.dbg.bytes_written);
+  osalDbgCheck(nandlog2.dbg.committed_bytes == nandlog2.dbg.bytes_written);
+  osalDbgCheck(nandlog.dbg.pages_written > nandlog2.dbg.pages_written);
+
+  chHeapFree(nandlogcfg2.arena);
+  chHeapFree(nandlogcfg.arena);
 }
 
 /*
@@ -92,20 +765,73 @@ void nandLogTest(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map)
   nandringcfg.nandp = nandp;
   uint8_t *ring_working_area = chHeapAlloc(NULL, nandRingWASize(nandp));
 
-  nandLogStart(&nandlog, &nandring, &nandringcfg, ring_working_area);
-
-
+  nandlogcfg.depth = NAND_LOG_DEPTH;
+  nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+  nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_working_area);
+  const uint32_t first_blk = nandring.cur_blk;
 
   WrittenBytesTotal = 0;
+  WrittenMsgTotal = 0;
   while(WrittenBytesTotal < (512 * 1000)) {
     write_block_test(&nandlog);
   }
+  while(WrittenBytesTotal < (1024 * 1000)) {
+    reserve_commit_test(&nandlog);
+  }
+  while(WrittenBytesTotal < (1536 * 1000)) {
+    writev_test(&nandlog);
+  }
+  for (size_t i=0; i<100; i++) {
+    flush_test(&nandlog, &nandring);
+  }
+  nandLogSetAutoFlush(&nandlog, MS2ST(AUTO_FLUSH_PERIOD_MS), 0);
+  for (size_t i=0; i<20; i++) {
+    auto_flush_test(&nandlog, &nandring);
+  }
+  nandLogSetAutoFlush(&nandlog, 0, 512);
+  while(WrittenBytesTotal < (2048 * 1000)) {
+    writev_test(&nandlog);
+  }
+  nandLogSetAutoFlush(&nandlog, 0, 0);
 
+  /* stop waits for single page write, not for worker wakeup */
+  const systime_t stop_start = chVTGetSystemTimeX();
+  nandLogStop(&nandlog);
+  osalDbgCheck(chVTTimeElapsedSinceX(stop_start) < MS2ST(10));
+  verify_session(nandp, &nandringcfg, first_blk,
+                 nandring.cur_blk, nandring.cur_page, WrittenMsgTotal);
 
+  osalDbgCheck(nandlog.dbg.high_water <= NAND_LOG_DEPTH);
+  chHeapFree(nandlogcfg.arena);
+
+  /* new sessions for overflow policies, its content is not verified */
+  const size_t depths[] = {NAND_LOG_DEPTH, NAND_LOG_DEEP_DEPTH};
+  for (size_t i=0; i<2; i++) {
+    nandlogcfg.depth = depths[i];
+    nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+    nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_working_area);
+    overflow_test(&nandlog, NAND_LOG_OVERFLOW_BLOCK);
+    overflow_test(&nandlog, NAND_LOG_OVERFLOW_TIMEOUT);
+    overflow_test(&nandlog, NAND_LOG_OVERFLOW_DROP_NEWEST);
+    overflow_test(&nandlog, NAND_LOG_OVERFLOW_DROP_OLDEST);
+    blocked_producer_test(&nandlog);
+    osalDbgCheck(nandlog.dbg.high_water > 0);
+    osalDbgCheck(nandlog.dbg.high_water <= nandlogcfg.depth);
+    stop_blocked_producer_test(&nandlog);
+    chHeapFree(nandlogcfg.arena);
+  }
+
+  producers_test(nandp, ring_working_area);
+  record_test(nandp, ring_working_area, false);
+  record_test(nandp, ring_working_area, true);
+  concurrent_reader_test(nandp, ring_working_area);
+
+  nandRingObjectInit(&nandring2);
+  nandLogObjectInit(&nandlog2);
+  uint8_t *ring_working_area2 = chHeapAlloc(NULL, nandRingWASize(nandp));
+  multiple_logs_test(nandp, ring_working_area, ring_working_area2);
+  chHeapFree(ring_working_area2);
 
-  nandLogStop(&nandlog);
-  nandRingUmount(&nandring);
-  nandRingStop(&nandring);
   chHeapFree(ring_working_area);
+  nandStop(nandp);
 }
-
@@ -6,11 +6,14 @@
 #include "nand_ring.h"
 #include "timeboot_u64.h"
 #include "soft_crc.h"
+#include "soft_ecc.h"
 #include "libnand.h"
 
 /*
- * Код строго однопоточный. Ориентирован на изолированную работу в
- * отдельном потоке.
+ * Запись, монтирование и итератор сессий ведутся из одного потока и
+ * шину NAND сами не захватывают, это делает вызывающий (поток NandLog).
+ * Функции чтения захватывают шину сами, поэтому могут работать в других
+ * потоках параллельно с записью.
  */
 
 /*
@@ -87,6 +90,12 @@
 
 #define MIN_RING_SIZE             32
 
+/* how many good blocks search probes forward to step over wasted headers */
+#define SEARCH_PROBE_WINDOW       8
+
+/* structures written by other format versions never pass CRC check */
+#define FORMAT_CRC_SEED           (0xFFFFFFFF ^ NAND_RING_FORMAT_VERSION)
+
 /*
  ******************************************************************************
  * EXTERNS
@@ -99,6 +108,8 @@
  ******************************************************************************
  */
 
+static void table_forget(NandRing *ring, uint32_t blk);
+
 /*
  ******************************************************************************
  * GLOBAL VARIABLES
@@ -113,6 +124,73 @@
  ******************************************************************************
  */
 
+/**
+ * @brief   Find first good block in range [from..to) using driver's bad
+ *          block map. Whole words of map are skipped at once.
+ */
+static uint32_t map_find_good(const bitmap_t *map, uint32_t from, uint32_t to) {
+
+  const size_t W = sizeof(bitmap_word_t) * 8;
+
+  while (from < to) {
+    const size_t w = from / W;
+    const bitmap_word_t good = ~map->array[w] & ((bitmap_word_t)-1 << (from % W));
+    if (0 != good) {
+      const uint32_t b = w * W + __builtin_ctz(good);
+      return (b < to) ? b : BLOCK_NOT_FOUND;
+    }
+    from = (w + 1) * W;
+  }
+
+  return BLOCK_NOT_FOUND;
+}
+
+/**
+ * @brief   Find last good block in range [from..to), reverse of
+ *          map_find_good().
+ */
+static uint32_t map_find_good_back(const bitmap_t *map, uint32_t from, uint32_t to) {
+
+  const size_t W = sizeof(bitmap_word_t) * 8;
+
+  while (from < to) {
+    const size_t w = (to - 1) / W;
+    const size_t top = (to - 1) % W;
+    bitmap_word_t good = ~map->array[w];
+    if (top < (W - 1)) {
+      good &= ((bitmap_word_t)1 << (top + 1)) - 1;
+    }
+    if (0 != good) {
+      const uint32_t b = w * W + (W - 1 - __builtin_clz(good));
+      return (b >= from) ? b : BLOCK_NOT_FOUND;
+    }
+    to = w * W;
+  }
+
+  return BLOCK_NOT_FOUND;
+}
+
+/**
+ * @brief   Count good blocks in ring range using driver's bad block map.
+ */
+static uint32_t map_count_good(const bitmap_t *map, uint32_t from, uint32_t to) {
+
+  const size_t W = sizeof(bitmap_word_t) * 8;
+  uint32_t ret = 0;
+
+  while (from < to) {
+    const size_t w = from / W;
+    bitmap_word_t mask = (bitmap_word_t)-1 << (from % W);
+    if ((to - w * W) < W) {
+      mask &= ((bitmap_word_t)1 << (to - w * W)) - 1;
+    }
+    ret += __builtin_popcount(~map->array[w] & mask);
+    from = (w + 1) * W;
+  }
+
+  return ret;
+}
+
 /**
  *
  */
@@ -125,6 +203,10 @@ static uint32_t get_total_good(const NandRing *ring) {
   const uint32_t start = ring->config->start_blk;
   const uint32_t len = ring->config->len;
 
+  if (NULL != nandp->bb_map) {
+    return map_count_good(nandp->bb_map, start, start + len);
+  }
+
   for (size_t b=0; b<len; b++) {
     if (! nandIsBad(nandp, start+b)) {
       ret++;
@@ -144,6 +226,15 @@ static uint32_t next_good(const NandRing *ring, uint32_t current) {
   NANDDriver *nandp    = ring->config->nandp;
   uint32_t b = current;
 
+  if (NULL != nandp->bb_map) {
+    b = map_find_good(nandp->bb_map, current + 1, start + len);
+    if (BLOCK_NOT_FOUND == b) {
+      b = map_find_good(nandp->bb_map, start, current + 1);
+    }
+    osalDbgCheck((BLOCK_NOT_FOUND != b) || (0 == ring->total_good));
+    return b;
+  }
+
   do {
     b++;
     if (b == (start + len)) {
@@ -154,8 +245,54 @@ static uint32_t next_good(const NandRing *ring, uint32_t current) {
     }
   } while (b != current); /* search wrapped without success */
 
-  const uint32_t total_good = get_total_good(ring);
-  osalDbgCheck(total_good <= 1); /* false negative result */
+  osalDbgCheck(ring->total_good <= 1); /* false negative result */
+  return BLOCK_NOT_FOUND;
+}
+
+/**
+ * @brief   Mark block bad keeping good blocks counter in sync.
+ */
+static void mark_bad(NandRing *ring, uint32_t blk) {
+
+  NANDDriver *nandp = ring->config->nandp;
+
+  if ((blk >= ring->config->start_blk)
+      && (blk < ring->config->start_blk + ring->config->len)
+      && (! nandIsBad(nandp, blk))) {
+    ring->total_good--;
+  }
+  ring->dbg.new_badblocks++;
+  nandMarkBad(nandp, blk);
+}
+
+/**
+ * @brief   Previous good block in ring, opposite to next_good().
+ */
+static uint32_t prev_good(const NandRing *ring, uint32_t current) {
+
+  const uint32_t len   = ring->config->len;
+  const uint32_t start = ring->config->start_blk;
+  NANDDriver *nandp    = ring->config->nandp;
+  uint32_t b = current;
+
+  if (NULL != nandp->bb_map) {
+    b = map_find_good_back(nandp->bb_map, start, current);
+    if (BLOCK_NOT_FOUND == b) {
+      b = map_find_good_back(nandp->bb_map, current, start + len);
+    }
+    return b;
+  }
+
+  do {
+    if (b == start) {
+      b = start + len;
+    }
+    b--;
+    if (! nandIsBad(nandp, b)) {
+      return b;
+    }
+  } while (b != current);
+
   return BLOCK_NOT_FOUND;
 }
 
@@ -175,24 +312,50 @@ static uint32_t erase_next(NandRing *ring, uint32_t cur_blk) {
     if (BLOCK_NOT_FOUND == blk) {
       return BLOCK_NOT_FOUND;
     }
+    table_forget(ring, blk);
     status = nandErase(nandp, blk);
     if (nandFailed(status)) {
       ring->dbg.erase_failed++;
-      ring->dbg.new_badblocks++;
-      nandMarkBad(nandp, blk);
+      mark_bad(ring, blk);
     }
   } while (nandFailed(status));
 
   return blk;
 }
 
+/**
+ * @brief   Get block to continue writing after cur_blk. Takes it from
+ *          erase-ahead reserve if possible, otherwise erases it right now.
+ */
+static uint32_t next_erased(NandRing *ring) {
+
+  if (ring->erased_ahead > 0) {
+    ring->erased_ahead--;
+    ring->dbg.reserve_hits++;
+    return next_good(ring, ring->cur_blk);
+  }
+  else {
+    ring->dbg.reserve_misses++;
+    return erase_next(ring, ring->cur_blk);
+  }
+}
+
 /**
  *
  */
 static uint32_t calc_spare_crc(const NandPageHeader *header) {
 
   const size_t len = sizeof(NandPageHeader) - sizeof(header->spare_crc);
-  return softcrc32((const uint8_t *)header, len, 0xFFFFFFFF);
+  return softcrc32((const uint8_t *)header, len, FORMAT_CRC_SEED);
+}
+
+/**
+ *
+ */
+static uint32_t calc_summary_crc(const NandBlockSummary *summary) {
+
+  const size_t len = sizeof(NandBlockSummary) - sizeof(summary->crc);
+  return softcrc32((const uint8_t *)summary, len, FORMAT_CRC_SEED);
 }
 
 /**
@@ -205,6 +368,35 @@ static bool header_crc_valid(const NandPageHeader *header) {
   return header->spare_crc == crc;
 }
 
+/**
+ * @brief   Check if all header bytes except bad mark have the same value.
+ */
+static bool header_filled(const NandPageHeader *header, uint8_t fill) {
+
+  const uint8_t *p = (const uint8_t *)header;
+
+  for (size_t i=sizeof(header->bad_mark); i<sizeof(NandPageHeader); i++) {
+    if (fill != p[i])
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief   Check if header is erased.
+ */
+static bool header_erased(const NandPageHeader *header) {
+  return header_filled(header, 0xFF);
+}
+
+/**
+ * @brief   Check if header with broken CRC is erased or zeroed
+ *          by close_prev_session().
+ */
+static bool header_blank(const NandPageHeader *header) {
+  return header_erased(header) || header_filled(header, 0x00);
+}
+
 /**
  * @brief Read page header and validate CRC.
  * @param ring
@@ -212,11 +404,12 @@ static bool header_crc_valid(const NandPageHeader *header) {
  * @param page
  * @return
  */
-static bool page_header(const NandRing *ring, uint32_t blk, uint32_t page,
+static bool page_header(NandRing *ring, uint32_t blk, uint32_t page,
                         NandPageHeader *header) {
 
   NANDDriver *nandp = ring->config->nandp;
   nandReadPageSpare(nandp, blk, page, (uint8_t *)header, sizeof(NandPageHeader));
+  ring->dbg.spare_reads++;
   return header_crc_valid(header);
 }
 
@@ -229,12 +422,33 @@ static uint32_t get_last_blk(const NandRing *ring) {
   return ring->config->start_blk + ring->config->len - 1;
 }
 
+/**
+ * @brief   Read id from page 0 header of the block.
+ * @param[out] erased   set if header is erased, may be NULL
+ * @retval  PAGE_ID_WASTED if header is erased or has broken CRC.
+ */
+static uint64_t block_id(NandRing *ring, uint32_t blk, bool *erased) {
+
+  NandPageHeader header;
+
+  if (page_header(ring, blk, 0, &header)) {
+    if (NULL != erased)
+      *erased = false;
+    return header.id;
+  }
+  else {
+    if (NULL != erased)
+      *erased = header_erased(&header);
+    return PAGE_ID_WASTED;
+  }
+}
+
 /**
  * @brief   Find last written block using brute force method starting
  *          from the first block of the ring
  * @return
  */
-static uint32_t last_written_block(const NandRing *ring) {
+static uint32_t last_written_block_brute(NandRing *ring) {
 
   /* very first block of ring */
   const uint32_t first = next_good(ring, get_last_blk(ring));
@@ -244,16 +458,11 @@ static uint32_t last_written_block(const NandRing *ring) {
   uint32_t last_blk = BLOCK_NOT_FOUND;
   uint64_t last_id  = PAGE_ID_FIRST;
   uint64_t id = PAGE_ID_WASTED;
-  NandPageHeader header;
 
   /* iterate over good blocks until block number wraps */
   uint32_t b = first;
   do {
-    if (page_header(ring, b, 0, &header))
-      id = header.id;
-    else
-      id = PAGE_ID_WASTED;
-
+    id = block_id(ring, b, NULL);
     if (id >= last_id) {
       last_blk = b;
       last_id  = id;
@@ -268,164 +477,1644 @@ static uint32_t last_written_block(const NandRing *ring) {
 }
 
 /**
- * @brief   Find last written page in the last written block
- * @param   ring
- * @param   last_blk
- * @return
+ * @brief   Find first good block with valid header in range [blk..last].
+ * @details Gives up after SEARCH_PROBE_WINDOW good blocks with wasted
+ *          headers in a row.
+ * @param[in] stop_on_erased  give up on the first erased block. Erased
+ *                            blocks never appear inside of written data,
+ *                            only after the last written block.
+ * @param[out] id   id of the found block
+ * @retval  BLOCK_NOT_FOUND if nothing found in probe window.
  */
-static uint32_t last_written_page(const NandRing *ring, uint32_t last_blk) {
+static uint32_t probe_valid(NandRing *ring, uint32_t blk, uint32_t last,
+                            bool stop_on_erased, uint64_t *id) {
 
-  osalDbgCheck(BLOCK_NOT_FOUND != last_blk);
+  NANDDriver *nandp = ring->config->nandp;
+  size_t probed = 0;
+  bool erased = false;
+
+  while ((blk <= last) && (probed < SEARCH_PROBE_WINDOW)) {
+    if (! nandIsBad(nandp, blk)) {
+      probed++;
+      *id = block_id(ring, blk, &erased);
+      if (PAGE_ID_WASTED != *id) {
+        return blk;
+      }
+      if (stop_on_erased && erased) {
+        return BLOCK_NOT_FOUND;
+      }
+    }
+    blk++;
+  }
 
-  uint64_t last_id = PAGE_ID_FIRST;
-  uint32_t last_page = LAST_PAGE_NOT_FOUND;
-  const size_t ppb = ring->config->nandp->config->pages_per_block;
-  NandPageHeader header;
-  uint64_t id = PAGE_ID_WASTED;
+  return BLOCK_NOT_FOUND;
+}
 
-  for (size_t page=0; page<ppb; page++) {
-    if (page_header(ring, last_blk, page, &header))
-      id = header.id;
-    else
-      id = PAGE_ID_WASTED;
+/**
+ * @brief   Find last written block using binary search.
+ * @details Ids of block headers grow monotonically along the ring and
+ *          have single discontinuity where the newest data meets the
+ *          oldest one. Every block from the beginning of the ring up to
+ *          the last written one has id not less than the id of the
+ *          first valid block, so this predicate is bisected. Bad blocks
+ *          and wasted headers (closed sessions, trashed blocks) are stepped
+ *          over by local linear probing.
+ * @note    Falls back to brute force when the ring looks empty or when
+ *          the result could not be confirmed.
+ */
+static uint32_t last_written_block_search(NandRing *ring) {
 
-    if (id >= last_id) {
-      last_page = page;
-      last_id   = id;
+  const uint32_t last = get_last_blk(ring);
+  uint64_t first_id = PAGE_ID_WASTED;
+  uint64_t id = PAGE_ID_WASTED;
+
+  uint32_t lo = probe_valid(ring, ring->config->start_blk, last, false,
+                            &first_id);
+  if (BLOCK_NOT_FOUND == lo) {
+    return last_written_block_brute(ring);
+  }
+  uint64_t lo_id = first_id;
+  uint32_t hi = last;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    const uint32_t b = probe_valid(ring, mid, hi, true, &id);
+    if ((BLOCK_NOT_FOUND != b) && (id >= first_id)) {
+      lo = b;
+      lo_id = id;
+    }
+    else {
+      hi = mid - 1;
     }
   }
 
-  /* last page search must be called after last block search which must
-     find at least one valid page */
-  osalDbgCheck(LAST_PAGE_NOT_FOUND != last_page);
+  /* newer block right after the found one means search was fooled
+     by long run of wasted headers */
+  if ((BLOCK_NOT_FOUND != probe_valid(ring, lo + 1, last, true, &id))
+      && (id >= lo_id)) {
+    return last_written_block_brute(ring);
+  }
 
-  return last_page;
+  return lo;
 }
 
 /**
- * @brief wa_size
- * @param nandp
+ * @brief   Find last written block using method selected in config.
  * @return
  */
-static uint32_t wa_size(const NANDDriver *nandp) {
-  return nandp->config->page_data_size + nandp->config->page_spare_size;
+static uint32_t last_written_block(NandRing *ring) {
+
+  if (NAND_RING_MOUNT_SEARCH == ring->config->mount_mode)
+    return last_written_block_search(ring);
+  else
+    return last_written_block_brute(ring);
 }
 
 /**
- * @brief Zero erased pages in the last block.
- * @param ring
- * @param last_blk
- * @param last_page
- * @return
+ * @brief   Physical block at logical position counted from the oldest
+ *          block of ring, i.e. the one right after the head.
  */
-static uint32_t close_prev_session(NandRing *ring, uint32_t last_blk,
-                                   uint32_t last_page) {
+static uint32_t logical_blk(const NandRing *ring, uint32_t pos) {
 
-  NANDDriver *nandp = ring->config->nandp;
-  const size_t ppb = nandp->config->pages_per_block;
-  const size_t pds = nandp->config->page_data_size;
+  const uint32_t start = ring->config->start_blk;
 
-  if (last_page != (ppb - 1)) {
-    memset(ring->wa, 0, wa_size(nandp));
-    ring->wa[pds]   = 0xFF;
-    ring->wa[pds+1] = 0xFF;
+  return start + (ring->cur_blk - start + 1 + pos) % ring->config->len;
+}
 
-    for (size_t page=last_page; page<ppb; page++) {
-      const uint8_t status = nandWritePageWhole(nandp, last_blk, page,
-                                                ring->wa, wa_size(nandp));
-      if (nandFailed(status)) {
-        ring->dbg.new_badblocks++;
-        nandMarkBad(nandp, last_blk);
+/**
+ * @brief   Logical position of block, inverse of logical_blk().
+ */
+static uint32_t logical_pos(const NandRing *ring, uint32_t blk) {
+
+  const uint32_t len = ring->config->len;
+
+  return (blk + 2 * len - ring->cur_blk - 1) % len;
+}
+
+/**
+ * @brief   Same as probe_valid() but walks logical positions [pos..last].
+ * @param[in] stop_on_erased  give up on the first erased block. Erased
+ *                            blocks only precede the oldest written one
+ *                            in logical order.
+ * @param[out] found  logical position of the found block
+ * @param[out] header page 0 header of the found block
+ */
+static bool probe_logical(NandRing *ring, uint32_t pos, uint32_t last,
+                          bool stop_on_erased, uint32_t *found,
+                          NandPageHeader *header) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  size_t probed = 0;
+
+  while ((pos <= last) && (probed < SEARCH_PROBE_WINDOW)) {
+    const uint32_t blk = logical_blk(ring, pos);
+    if (! nandIsBad(nandp, blk)) {
+      probed++;
+      if (page_header(ring, blk, 0, header)) {
+        *found = pos;
+        return true;
+      }
+      if (stop_on_erased && header_erased(header)) {
+        return false;
       }
     }
+    pos++;
   }
 
-  return erase_next(ring, last_blk);
+  return false;
 }
 
 /**
- *
+ * @brief   Check that page of block starting with first_id holds id.
  */
-static uint32_t mkfs(NandRing *ring) {
+static bool seek_in_block(NandRing *ring, uint32_t blk, uint64_t first_id,
+                          uint64_t id, uint32_t *page) {
 
-  return erase_next(ring, get_last_blk(ring));
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  NandPageHeader header;
+
+  if ((id < first_id) || ((id - first_id) >= ppb))
+    return false;
+
+  *page = id - first_id;
+  return page_header(ring, blk, *page, &header) && (id == header.id);
 }
 
 /**
- * @brief   Move data from failed block to new one and set bad mark in old.
- * @retval  New block number.
+ * @brief   Find page by id checking page 0 of every block.
  */
-static uint32_t block_data_rescue(NandRing *ring, uint32_t failed_blk,
-                                  uint32_t failed_page) {
+static bool seek_id_brute(NandRing *ring, uint64_t id, uint32_t *blk,
+                          uint32_t *page) {
 
   NANDDriver *nandp = ring->config->nandp;
-  uint32_t target_blk;
-  uint8_t status = NAND_STATUS_FAILED;
 
-  if (failed_page > 0) {
-    RETRY:
-    target_blk = erase_next(ring, ring->cur_blk);
-    if (BLOCK_NOT_FOUND == target_blk) {
-      return BLOCK_NOT_FOUND;
+  for (uint32_t pos=0; pos<ring->config->len; pos++) {
+    const uint32_t b = logical_blk(ring, pos);
+    if (nandIsBad(nandp, b))
+      continue;
+    const uint64_t first_id = block_id(ring, b, NULL);
+    if ((PAGE_ID_WASTED != first_id) && seek_in_block(ring, b, first_id, id, page)) {
+      *blk = b;
+      return true;
     }
-    status = nandDataMove(nandp, failed_blk, target_blk, failed_page, ring->wa);
-    ring->dbg.data_rescue++;
-    if (nandFailed(status)) {
-      nandMarkBad(nandp, target_blk);
-      ring->dbg.new_badblocks++;
-      goto RETRY;
+  }
+
+  return false;
+}
+
+/**
+ * @brief   Physical block at position counted from the first block of
+ *          session.
+ */
+static uint32_t session_blk(const NandRing *ring, const NandRingSession *session,
+                            uint32_t pos) {
+
+  const uint32_t start = ring->config->start_blk;
+
+  return start + (session->first_blk - start + pos) % ring->config->len;
+}
+
+/**
+ * @brief   Boot time of the first readable page 0 header at session
+ *          positions [pos..last].
+ * @param[out] found  position of the block holding that header
+ */
+static bool probe_session(NandRing *ring, const NandRingSession *session,
+                          uint32_t pos, uint32_t last, uint32_t *found,
+                          uint64_t *time) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  NandPageHeader header;
+  size_t probed = 0;
+
+  while ((pos <= last) && (probed < SEARCH_PROBE_WINDOW)) {
+    const uint32_t blk = session_blk(ring, session, pos);
+    if (! nandIsBad(nandp, blk)) {
+      probed++;
+      if (page_header(ring, blk, 0, &header)) {
+        *found = pos;
+        *time = header.time_boot_us;
+        return true;
+      }
     }
+    pos++;
   }
-  else {
-    target_blk = erase_next(ring, ring->cur_blk);
-    if (BLOCK_NOT_FOUND == target_blk) {
-      return BLOCK_NOT_FOUND;
+
+  return false;
+}
+
+/**
+ * @brief   Boot time of the first readable header at pages [page..last]
+ *          of block.
+ */
+static bool probe_page(NandRing *ring, uint32_t blk, uint32_t page,
+                       uint32_t last, uint32_t *found, uint64_t *time) {
+
+  NandPageHeader header;
+  size_t probed = 0;
+
+  while ((page <= last) && (probed < SEARCH_PROBE_WINDOW)) {
+    probed++;
+    if (page_header(ring, blk, page, &header)) {
+      *found = page;
+      *time = header.time_boot_us;
+      return true;
     }
+    page++;
   }
 
-  return target_blk;
+  return false;
 }
 
 /**
- * @brief seal_header
- * @param ring
- * @param header
- * @param page_ecc
- * @param actually_written
+ * @brief   Position of the last session block starting before boot
+ *          time, bisected over page 0 headers.
  */
-static void fill_header(const NandRing *ring, NandPageHeader *header,
-                        uint32_t page_ecc, uint32_t actually_written) {
+static uint32_t seek_time_pos(NandRing *ring, const NandRingSession *session,
+                              uint64_t t) {
+
+  uint32_t lo = 0;
+  uint32_t hi = (session->last_blk - session->first_blk + ring->config->len)
+                % ring->config->len;
+  uint32_t found;
+  uint64_t time;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (probe_session(ring, session, mid, hi, &found, &time) && (time < t))
+      lo = found;
+    else
+      hi = mid - 1;
+  }
 
-  header->page_ecc       = page_ecc;
-  header->bad_mark       = 0xFFFF;
-  header->id             = ring->cur_id;
-  header->utc_correction = ring->utc_correction;
-  header->time_boot_us   = timebootU64();
-  header->back_link      = ring->cur_back_link;
-  header->written        = actually_written;
+  return lo;
+}
 
-  /* must be at the very end of operation */
-  header->spare_crc      = calc_spare_crc(header);
+/**
+ * @brief   Read summary stored in the last page of block.
+ * @details Only summary itself is read, it has its own CRC.
+ */
+static bool block_summary(NandRing *ring, uint32_t blk,
+                          NandBlockSummary *summary) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  NandPageHeader header;
+
+  if (nandIsBad(nandp, blk)
+      || ! page_header(ring, blk, ppb - 1, &header)
+      || (NAND_RING_SUMMARY_PAGE != header.first_record))
+    return false;
+
+  nandReadPageData(nandp, blk, ppb - 1, summary, sizeof(NandBlockSummary), NULL);
+  return (summary->crc == calc_summary_crc(summary))
+      && (summary->last_id + 1 == header.id);
+}
+
+/**
+ * @brief   Add block summary to range total.
+ */
+static void summary_merge(NandBlockSummary *total,
+                          const NandBlockSummary *summary) {
+
+  if (PAGE_ID_WASTED == total->first_id) {
+    total->first_id = summary->first_id;
+    total->time_min_us = summary->time_min_us;
+  }
+  total->last_id = summary->last_id;
+  total->time_max_us = summary->time_max_us;
+  total->utc_correction = summary->utc_correction;
+  total->records += summary->records;
+  for (size_t i=0; i<NAND_RING_SUMMARY_TYPES; i++)
+    total->types[i] += summary->types[i];
+}
+
+/**
+ * @brief   Checkpoint area is configured and still has good blocks.
+ */
+static bool cp_enabled(const NandRing *ring) {
+  return (ring->config->checkpoint_len > 0) && (BLOCK_NOT_FOUND != ring->cp_blk);
+}
+
+/**
+ *
+ */
+static uint32_t calc_cp_crc(const NandRingCheckpoint *cp) {
+
+  const size_t len = sizeof(NandRingCheckpoint) - sizeof(cp->crc);
+  return softcrc32((const uint8_t *)cp, len, FORMAT_CRC_SEED);
+}
+
+/**
+ * @brief   Read checkpoint record and validate CRC.
+ */
+static bool cp_read(NandRing *ring, uint32_t blk, uint32_t page,
+                    NandRingCheckpoint *cp) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  nandReadPageSpare(nandp, blk, page, (uint8_t *)cp, sizeof(NandRingCheckpoint));
+  ring->dbg.spare_reads++;
+  return cp->crc == calc_cp_crc(cp);
+}
+
+/**
+ * @brief   Next good block of checkpoint area.
+ * @param   current   pass BLOCK_NOT_FOUND to get the very first one.
+ */
+static uint32_t cp_next_good(const NandRing *ring, uint32_t current) {
+
+  const uint32_t start = ring->config->checkpoint_blk;
+  const uint32_t len   = ring->config->checkpoint_len;
+  NANDDriver *nandp    = ring->config->nandp;
+  uint32_t b = (BLOCK_NOT_FOUND == current) ? start + len - 1 : current;
+
+  for (size_t i=0; i<len; i++) {
+    b++;
+    if (b == (start + len)) {
+      b = start;
+    }
+    if (! nandIsBad(nandp, b)) {
+      return b;
+    }
+  }
+
+  return BLOCK_NOT_FOUND;
+}
+
+/**
+ * @brief   Find the newest valid checkpoint.
+ * @details Checkpoints are written in page order, so the newest block
+ *          is chosen by its first record and the last record inside it
+ *          is located by binary search. Also sets position for the next
+ *          checkpoint write.
+ */
+static bool cp_load(NandRing *ring, NandRingCheckpoint *cp) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const uint32_t start = ring->config->checkpoint_blk;
+  const uint32_t len = ring->config->checkpoint_len;
+  NandRingCheckpoint tmp;
+  uint32_t blk = BLOCK_NOT_FOUND;
+  uint64_t first_id = PAGE_ID_WASTED;
+
+  for (uint32_t b=start; b<start+len; b++) {
+    if (!nandIsBad(nandp, b) && cp_read(ring, b, 0, &tmp) && (tmp.id >= first_id)) {
+      blk = b;
+      first_id = tmp.id;
+      *cp = tmp;
+    }
+  }
+
+  if (BLOCK_NOT_FOUND == blk) {
+    /* next write erases first good block of area */
+    ring->cp_blk = cp_next_good(ring, BLOCK_NOT_FOUND);
+    ring->cp_page = ppb;
+    return false;
+  }
+
+  uint32_t lo = 0;
+  uint32_t hi = ppb - 1;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (cp_read(ring, blk, mid, &tmp) && (tmp.id >= first_id)) {
+      lo = mid;
+      *cp = tmp;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+
+  /* append to the same block if the page after the last record
+     is clean, otherwise start new block on next write */
+  ring->cp_blk = blk;
+  ring->cp_page = ppb;
+  if ((lo + 1) < ppb) {
+    cp_read(ring, blk, lo + 1, &tmp);
+    const uint8_t *p = (const uint8_t *)&tmp;
+    ring->cp_page = lo + 1;
+    for (size_t i=0; i<sizeof(tmp); i++) {
+      if (0xFF != p[i]) {
+        ring->cp_page = ppb;
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Store current ring position into checkpoint area.
+ * @details Blocks of area are used in ping-pong fashion: the next block
+ *          is erased only when the current one is full, so the newest
+ *          checkpoint always survives power loss.
+ */
+static void cp_write(NandRing *ring) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  NandRingCheckpoint cp;
+  uint8_t status = NAND_STATUS_FAILED;
+
+  ring->cp_countdown = ring->config->checkpoint_period;
+  if ((! cp_enabled(ring)) || (BLOCK_NOT_FOUND == ring->cur_blk)) {
+    return;
+  }
+
+  cp.bad_mark  = 0xFFFF;
+  cp.id        = ring->cur_id - ring->cur_page;
+  cp.cur_blk   = ring->cur_blk;
+  cp.back_link = ring->cur_back_link;
+  cp.crc       = calc_cp_crc(&cp);
+
+  do {
+    if (ring->cp_page >= ppb) {
+      ring->cp_blk = cp_next_good(ring, ring->cp_blk);
+      if (BLOCK_NOT_FOUND == ring->cp_blk) {
+        return;
+      }
+      ring->cp_page = 0;
+      status = nandErase(nandp, ring->cp_blk);
+      if (nandFailed(status)) {
+        ring->dbg.erase_failed++;
+        mark_bad(ring, ring->cp_blk);
+        ring->cp_page = ppb;
+        continue;
+      }
+    }
+    status = nandWritePageSpare(nandp, ring->cp_blk, ring->cp_page,
+                                (uint8_t *)&cp, sizeof(cp));
+    ring->cp_page++;
+    if (nandFailed(status)) {
+      mark_bad(ring, ring->cp_blk);
+      ring->cp_page = ppb;
+    }
+  } while (nandFailed(status));
+
+  ring->dbg.checkpoint_writes++;
+}
+
+/**
+ * @brief   Find last written block starting from the newest checkpoint.
+ * @details Ring data written after checkpoint always lies in the run of
+ *          blocks with growing ids starting from the checkpointed block,
+ *          so only a few blocks must be read to reach the head. Closed
+ *          sessions (zeroed headers) are stepped over like in search.
+ * @param[out] last_blk   last written block
+ * @retval  false if checkpoint is absent or does not match ring data.
+ */
+static bool cp_last_written_block(NandRing *ring, uint32_t *last_blk) {
+
+  NandRingCheckpoint cp;
+  uint64_t id, head_id;
+  uint32_t head;
+  bool erased = false;
+  size_t holes = 0;
+
+  if ((! cp_enabled(ring)) || (! cp_load(ring, &cp))) {
+    return false;
+  }
+  if ((cp.cur_blk < ring->config->start_blk) || (cp.cur_blk > get_last_blk(ring))
+      || nandIsBad(ring->config->nandp, cp.cur_blk)) {
+    return false;
+  }
+
+  uint32_t p = cp.cur_blk;
+  id = block_id(ring, p, &erased);
+  if (PAGE_ID_WASTED != id) {
+    if (id != cp.id)
+      return false; /* checkpoint is stale or ring was erased */
+    head = p;
+    head_id = id;
+  }
+  else {
+    /* nothing written in checkpointed block yet, head is somewhere
+       behind it, possibly behind some closed sessions */
+    const bool cp_erased = erased;
+    head = p;
+    do {
+      head = prev_good(ring, head);
+      if (BLOCK_NOT_FOUND == head)
+        return false;
+      head_id = block_id(ring, head, &erased);
+      holes++;
+    } while ((PAGE_ID_WASTED == head_id) && (! erased)
+             && (holes < SEARCH_PROBE_WINDOW));
+    if ((PAGE_ID_WASTED == head_id) || (head_id >= cp.id))
+      return false;
+    if (cp_erased) {
+      *last_blk = head;
+      return true;
+    }
+    holes = 1;
+  }
+
+  for (size_t i=0; i<ring->config->len; i++) {
+    p = next_good(ring, p);
+    if (BLOCK_NOT_FOUND == p)
+      return false;
+    id = block_id(ring, p, &erased);
+    if (PAGE_ID_WASTED != id) {
+      if (id < head_id)
+        break;
+      head = p;
+      head_id = id;
+      holes = 0;
+    }
+    else if (erased || (++holes >= SEARCH_PROBE_WINDOW)) {
+      break;
+    }
+  }
+
+  *last_blk = head;
+  return true;
+}
+
+/**
+ * @brief   Find last written page in the last written block using
+ *          brute force method.
+ * @param   ring
+ * @param   last_blk
+ * @return
+ */
+static uint32_t last_written_page_brute(NandRing *ring, uint32_t last_blk) {
+
+  osalDbgCheck(BLOCK_NOT_FOUND != last_blk);
+
+  uint64_t last_id = PAGE_ID_FIRST;
+  uint32_t last_page = LAST_PAGE_NOT_FOUND;
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  NandPageHeader header;
+  uint64_t id = PAGE_ID_WASTED;
+
+  for (size_t page=0; page<ppb; page++) {
+    if (page_header(ring, last_blk, page, &header))
+      id = header.id;
+    else
+      id = PAGE_ID_WASTED;
+
+    if (id >= last_id) {
+      last_page = page;
+      last_id   = id;
+    }
+  }
+
+  /* last page search must be called after last block search which must
+     find at least one valid page */
+  osalDbgCheck(LAST_PAGE_NOT_FOUND != last_page);
+
+  return last_page;
+}
+
+/**
+ * @brief   Find last written page in the last written block using
+ *          binary search.
+ * @details Pages are programmed strictly in order and ids inside block
+ *          are consecutive, so valid pages form a prefix of the block
+ *          followed by erased or zeroed ones. Any other header found
+ *          during search (broken CRC, unexpected id) falls back to brute
+ *          force scan of whole block.
+ * @param   ring
+ * @param   last_blk
+ * @return
+ */
+static uint32_t last_written_page_search(NandRing *ring, uint32_t last_blk) {
+
+  osalDbgCheck(BLOCK_NOT_FOUND != last_blk);
+
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  NandPageHeader header;
+  uint32_t lo = 0;
+  uint32_t hi = ppb - 1;
+
+  if (! page_header(ring, last_blk, 0, &header)) {
+    return last_written_page_brute(ring, last_blk);
+  }
+  const uint64_t first_id = header.id;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (page_header(ring, last_blk, mid, &header)) {
+      if (header.id != first_id + mid) {
+        return last_written_page_brute(ring, last_blk);
+      }
+      lo = mid;
+    }
+    else {
+      if (! header_blank(&header)) {
+        return last_written_page_brute(ring, last_blk);
+      }
+      hi = mid - 1;
+    }
+  }
+
+  return lo;
+}
+
+/**
+ * @brief   Find last written page using method selected in config.
+ * @param   ring
+ * @param   last_blk
+ * @return
+ */
+static uint32_t last_written_page(NandRing *ring, uint32_t last_blk) {
+
+  if (NAND_RING_MOUNT_SEARCH == ring->config->mount_mode)
+    return last_written_page_search(ring, last_blk);
+  else
+    return last_written_page_brute(ring, last_blk);
+}
+
+/**
+ * @brief wa_size
+ * @param nandp
+ * @return
+ */
+static uint32_t wa_size(const NANDDriver *nandp) {
+  return nandp->config->page_data_size + nandp->config->page_spare_size;
+}
+
+/**
+ * @brief Zero erased pages in the last block.
+ * @param ring
+ * @param last_blk
+ * @param last_page
+ * @return
+ */
+static uint32_t close_prev_session(NandRing *ring, uint32_t last_blk,
+                                   uint32_t last_page) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+
+  if (last_page != (ppb - 1)) {
+    memset(ring->wa, 0, wa_size(nandp));
+    ring->wa[pds]   = 0xFF;
+    ring->wa[pds+1] = 0xFF;
+
+    for (size_t page=last_page; page<ppb; page++) {
+      const uint8_t status = nandWritePageWhole(nandp, last_blk, page,
+                                                ring->wa, wa_size(nandp));
+      if (nandFailed(status)) {
+        mark_bad(ring, last_blk);
+      }
+    }
+  }
+
+  return erase_next(ring, last_blk);
+}
+
+/**
+ * @brief   Remember the last valid page left by close_prev_session().
+ * @details Last written page gets zeroed unless it is the last page of
+ *          block, head stays unknown when no valid page left in block.
+ */
+static void set_closed_head(NandRing *ring, uint32_t last_blk,
+                            uint32_t last_page) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+
+  if (nandIsBad(nandp, last_blk) || (0 == last_page)) {
+    ring->head_blk = BLOCK_NOT_FOUND;
+  }
+  else {
+    ring->head_blk = last_blk;
+    ring->head_page = (last_page == (ppb - 1)) ? last_page : last_page - 1;
+  }
+}
+
+/**
+ * @brief   Session table entry counted from the oldest one.
+ */
+static NandRingSession *table_entry(const NandRing *ring, size_t pos) {
+
+  const NandRingConfig *cfg = ring->config;
+
+  return &cfg->sessions[(ring->st_oldest + pos) % cfg->sessions_len];
+}
+
+/**
+ * @brief   Fill session table using iterator. Keeps the newest sessions
+ *          when table is too short.
+ */
+static void table_build(NandRing *ring) {
+
+  const size_t len = ring->config->sessions_len;
+  NandRingIterator it;
+  NandRingSession session;
+
+  ring->st_oldest = 0;
+  ring->st_count = 0;
+  ring->st_open = false;
+
+  /* iterator returns the newest session first, so fill from the end */
+  NandRingIteratorBind(&it, ring);
+  while ((ring->st_count < len)
+         && (OSAL_SUCCESS == NandRingIteratorNext(&it, &session))) {
+    ring->st_count++;
+    ring->config->sessions[len - ring->st_count] = session;
+  }
+  NandRingIteratorRelease(&it);
+  ring->st_oldest = (len - ring->st_count) % len;
+}
+
+/**
+ * @brief   Account page just written by the current session.
+ */
+static void table_account(NandRing *ring, const NandPageHeader *header) {
+
+  const size_t len = ring->config->sessions_len;
+  NandRingSession *s;
+
+  if (NULL == ring->config->sessions)
+    return;
+
+  osalSysLock();
+  if (! ring->st_open) {
+    if (ring->st_count == len) {
+      ring->st_oldest = (ring->st_oldest + 1) % len;
+      ring->st_count--;
+    }
+    s = table_entry(ring, ring->st_count);
+    ring->st_count++;
+    ring->st_open = true;
+    /* whole page mode seals copy of header, so its id is not set */
+    s->id = ring->cur_id;
+    s->time_boot_us = header->time_boot_us;
+    s->first_blk = ring->cur_blk;
+    s->pages = 0;
+  }
+  s = table_entry(ring, ring->st_count - 1);
+  s->utc_correction = header->utc_correction;
+  s->last_blk = ring->cur_blk;
+  s->last_page = ring->cur_page;
+  s->pages++;
+  osalSysUnlock();
+}
+
+/**
+ * @brief   Update current session after its data moved out of failed block.
+ */
+static void table_moved(NandRing *ring, uint32_t failed_blk, uint32_t blk) {
+
+  if ((NULL == ring->config->sessions) || (! ring->st_open))
+    return;
+
+  osalSysLock();
+  NandRingSession *s = table_entry(ring, ring->st_count - 1);
+  if (s->first_blk == failed_blk)
+    s->first_blk = blk;
+  if (s->last_blk == failed_blk)
+    s->last_blk = blk;
+  osalSysUnlock();
+}
+
+/**
+ * @brief   Drop block going to be erased from the oldest session.
+ * @details Ring erases blocks strictly in order, so only the first block
+ *          of the oldest session may be hit. All blocks of session except
+ *          the last one are full, so the next block starts exactly ppb
+ *          pages later.
+ */
+static void table_forget(NandRing *ring, uint32_t blk) {
+
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  NandPageHeader header;
+
+  if ((NULL == ring->config->sessions) || (0 == ring->st_count))
+    return;
+
+  NandRingSession *s = table_entry(ring, 0);
+  if (s->first_blk != blk)
+    return;
+
+  if (s->last_blk == blk) {
+    osalSysLock();
+    ring->st_oldest = (ring->st_oldest + 1) % ring->config->sessions_len;
+    ring->st_count--;
+    osalSysUnlock();
+  }
+  else {
+    const uint32_t next = next_good(ring, blk);
+    const bool valid = page_header(ring, next, 0, &header);
+    osalSysLock();
+    s->first_blk = next;
+    s->id += ppb;
+    s->pages -= ppb;
+    if (valid)
+      s->time_boot_us = header.time_boot_us;
+    osalSysUnlock();
+  }
+}
+
+/**
+ *
+ */
+static uint32_t mkfs(NandRing *ring) {
+
+  return erase_next(ring, get_last_blk(ring));
+}
+
+/**
+ * @brief   Move data from failed block to new one and set bad mark in old.
+ * @retval  New block number.
+ */
+static uint32_t block_data_rescue(NandRing *ring, uint32_t failed_blk,
+                                  uint32_t failed_page) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  uint32_t target_blk;
+  uint8_t status = NAND_STATUS_FAILED;
+
+  if (failed_page > 0) {
+    RETRY:
+    target_blk = next_erased(ring);
+    if (BLOCK_NOT_FOUND == target_blk) {
+      return BLOCK_NOT_FOUND;
+    }
+    status = nandDataMove(nandp, failed_blk, target_blk, failed_page, ring->wa);
+    ring->dbg.data_rescue++;
+    if (nandFailed(status)) {
+      mark_bad(ring, target_blk);
+      goto RETRY;
+    }
+  }
+  else {
+    target_blk = next_erased(ring);
+    if (BLOCK_NOT_FOUND == target_blk) {
+      return BLOCK_NOT_FOUND;
+    }
+  }
+
+  return target_blk;
+}
+
+/**
+ * @brief   Fill header fields common for all pages written by single call.
+ * @param ring
+ * @param header
+ * @param actually_written
+ */
+static void fill_header(const NandRing *ring, NandPageHeader *header,
+                        uint32_t actually_written) {
+
+  header->bad_mark       = 0xFFFF;
+  header->utc_correction = ring->utc_correction;
+  header->time_boot_us   = timebootU64();
+  header->back_link      = ring->cur_back_link;
+  header->written        = actually_written;
+  header->first_record   = NAND_RING_NO_RECORD;
+}
+
+/**
+ * @brief   Fill page specific fields of header and seal it.
+ * @param ring
+ * @param header
+ * @param page_ecc
+ */
+static void seal_header(const NandRing *ring, NandPageHeader *header,
+                        uint32_t page_ecc) {
+
+  header->id             = ring->cur_id;
+  header->page_ecc       = page_ecc;
+
+  /* must be at the very end of operation */
+  header->spare_crc      = calc_spare_crc(header);
+}
+
+/**
+ * @brief   Assemble page data and sealed header in working area and
+ *          program them using single operation.
+ * @note    ECC calculated in software because hardware one is available
+ *          only after programming.
+ */
+static uint8_t write_whole_page(NandRing *ring, const uint8_t *data,
+                                const NandPageHeader *header) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t pss = nandp->config->page_spare_size;
+  NandPageHeader *seal = (NandPageHeader *)&ring->wa[pds];
+
+  /* summary page is rendered in working area already */
+  if (data != ring->wa)
+    memcpy(ring->wa, data, pds);
+  memset(&ring->wa[pds], 0xFF, pss);
+  memcpy(seal, header, sizeof(NandPageHeader));
+  seal_header(ring, seal, softecc(ring->wa, pds));
+
+  return nandWritePageWhole(nandp, ring->cur_blk, ring->cur_page,
+                            ring->wa, wa_size(nandp));
+}
+
+/**
+ * @brief   Account data page just written in summary of current block.
+ */
+static void summary_account(NandRing *ring, const uint8_t *data,
+                            const NandPageHeader *header) {
+
+  NandBlockSummary *s = &ring->summary;
+
+  if (0 == ring->cur_page) {
+    memset(s, 0, sizeof(NandBlockSummary));
+    s->first_id = ring->cur_id;
+    s->time_min_us = header->time_boot_us;
+    s->time_max_us = header->time_boot_us;
+  }
+  s->last_id = ring->cur_id;
+  s->utc_correction = header->utc_correction;
+  if (header->time_boot_us < s->time_min_us)
+    s->time_min_us = header->time_boot_us;
+  if (header->time_boot_us > s->time_max_us)
+    s->time_max_us = header->time_boot_us;
+  if (NULL != ring->config->summary_cb)
+    ring->config->summary_cb(s, data, header);
+}
+
+/**
+ * @brief   Render summary page data into working area.
+ * @note    Called on every write attempt, because data rescue uses
+ *          working area too.
+ */
+static const uint8_t *summary_render(NandRing *ring) {
+
+  const size_t pds = ring->config->nandp->config->page_data_size;
+
+  ring->summary.crc = calc_summary_crc(&ring->summary);
+  memset(ring->wa, 0xFF, pds);
+  memcpy(ring->wa, &ring->summary, sizeof(NandBlockSummary));
+
+  return ring->wa;
+}
+
+/**
+ * @brief fill_session
+ * @param hdr_first
+ * @param hdr_last
+ * @param result
+ */
+static void fill_session(const NandRingIterator *it,
+                         const NandPageHeader *hdr_first,
+                         const NandPageHeader *hdr_last,
+                         uint32_t first_blk, uint32_t last_page,
+                         NandRingSession *result) {
+
+  result->id = hdr_first->id;
+  result->time_boot_us = hdr_first->time_boot_us;
+  result->utc_correction = hdr_last->utc_correction;
+  result->first_blk = first_blk;
+  result->last_blk = it->last_blk;
+  result->last_page = last_page;
+  result->pages = hdr_last->id - hdr_first->id + 1;
+}
+
+/**
+ * @brief   Write page data and seal it.
+ * @details In summary mode the last page of block gets summary right
+ *          after the last data page.
+ * @param[in] data    page data, NULL for block summary page
+ * @param[in] header  template filled by fill_header()
+ * @return  OSAL_FAILED when ring ran out of space. Data page is stored
+ *          already then if rollover or its block summary failed, although
+ *          write_batch() reports it as unwritten.
+ */
+static bool write_page(NandRing *ring, const uint8_t *data,
+                       NandPageHeader *header) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  const uint8_t *page = data;
+  uint32_t page_ecc;
+  uint8_t status = NAND_STATUS_FAILED;
+
+RETRY:
+  if (NULL == data)
+    page = summary_render(ring);
+
+  if (NAND_RING_WRITE_WHOLE == ring->config->write_mode) {
+    /* data and seal in single program operation */
+    status = write_whole_page(ring, page, header);
+    if (nandFailed(status)) {
+      ring->dbg.write_data_failed++;
+      goto RESCUE;
+    }
+  }
+  else {
+    /* write page data */
+    status = nandWritePageData(nandp, ring->cur_blk, ring->cur_page,
+                               page, pds, &page_ecc);
+    if (nandFailed(status)) {
+      ring->dbg.write_data_failed++;
+      goto RESCUE;
+    }
+
+    /* seal page using spare area */
+    seal_header(ring, header, page_ecc);
+    status = nandWritePageSpare(nandp, ring->cur_blk, ring->cur_page,
+                                (uint8_t *)header, sizeof(NandPageHeader));
+    if (nandFailed(status)) {
+      ring->dbg.write_spare_failed++;
+      goto RESCUE;
+    }
+  }
+
+  /* prepare next iteration */
+  ring->head_blk = ring->cur_blk;
+  ring->head_page = ring->cur_page;
+  table_account(ring, header);
+  if (NULL == data)
+    ring->dbg.summary_writes++;
+  else if (ring->config->block_summary)
+    summary_account(ring, data, header);
+  ring->cur_id++;
+  ring->cur_page++;
+  if ((NULL != data) && ring->config->block_summary
+      && (ring->cur_page == ppb - 1)) {
+    /* data page is already stored, ring state reports lack of space
+       like on rollover, counter tells it from data page failure */
+    NandPageHeader summary;
+    const uint32_t summaries = ring->dbg.summary_writes;
+    fill_header(ring, &summary, sizeof(NandBlockSummary));
+    summary.first_record = NAND_RING_SUMMARY_PAGE;
+    if (OSAL_SUCCESS != write_page(ring, NULL, &summary)) {
+      /* stored summary followed by failed rollover is not its failure */
+      if (summaries == ring->dbg.summary_writes)
+        ring->dbg.summary_failed++;
+      return OSAL_FAILED;
+    }
+    return OSAL_SUCCESS;
+  }
+  if (ring->cur_page == ppb) {
+    ring->cur_page = 0;
+    const uint32_t b = next_erased(ring);
+    if (BLOCK_NOT_FOUND == b)
+      goto NO_SPACE;
+    else
+      ring->cur_blk = b;
+    if (cp_enabled(ring) && (0 == --ring->cp_countdown)) {
+      cp_write(ring);
+    }
+  }
+
+  return OSAL_SUCCESS;
+
+RESCUE:
+  {
+    /* bad mark lands in spare of pages 0 and 1 breaking their CRC,
+       so block gets marked only after its data moved */
+    const uint32_t b = block_data_rescue(ring, ring->cur_blk, ring->cur_page);
+    mark_bad(ring, ring->cur_blk);
+    if (BLOCK_NOT_FOUND == b)
+      goto NO_SPACE;
+    table_moved(ring, ring->cur_blk, b);
+    ring->cur_blk = b;
+  }
+  cp_write(ring);
+  goto RETRY;
+
+NO_SPACE:
+  ring->state = NAND_RING_NO_SPACE;
+  return OSAL_FAILED;
+}
+
+/**
+ * @brief   Account single nandRingWritePage() call in latency statistics.
+ */
+static void account_latency(NandRing *ring, rtcnt_t start) {
+
+  const uint32_t us = RTC2US(halGetCounterFrequency(), chSysGetRealtimeCounterX() - start);
+  size_t bucket = us / NAND_RING_LATENCY_STEP_US;
+
+  if (bucket >= NAND_RING_LATENCY_BUCKETS)
+    bucket = NAND_RING_LATENCY_BUCKETS - 1;
+  ring->dbg.write_latency_hist[bucket]++;
+  if (us > ring->dbg.write_latency_max_us)
+    ring->dbg.write_latency_max_us = us;
+}
+
+/**
+ * @brief   Write run of pages sharing single header template.
+ * @details Only time stamp gets refreshed for every page, so it tells
+ *          when page was written even in long batch.
+ * @param[in] pagev   array of page buffers or NULL
+ * @param[in] data    contiguous page buffers, used when pagev is NULL
+ * @param[in] written useful bytes in every page or NULL for full pages
+ * @param[in] first   first record offset in every page or NULL for
+ *                    unframed data
+ * @return  Number of successfully written pages.
+ */
+static size_t write_batch(NandRing *ring, const uint8_t * const *pagev,
+                          const uint8_t *data, const uint16_t *written,
+                          const uint16_t *first, size_t npages) {
+
+  osalDbgCheck(NULL != ring);
+  if (NAND_RING_NO_SPACE == ring->state)
+    return 0;
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  const size_t pds = ring->config->nandp->config->page_data_size;
+  NandPageHeader header;
+  size_t i;
+
+  fill_header(ring, &header, pds);
+  for (i=0; i<npages; i++) {
+    const uint8_t *page = (NULL != pagev) ? pagev[i] : &data[i * pds];
+    header.time_boot_us = timebootU64();
+    if (NULL != written) {
+      osalDbgCheck(written[i] <= pds);
+      header.written = written[i];
+    }
+    if (NULL != first) {
+      osalDbgCheck((NAND_RING_NO_RECORD == first[i]) || (first[i] < header.written));
+      header.first_record = first[i];
+    }
+    const rtcnt_t start = chSysGetRealtimeCounterX();
+    const bool status = write_page(ring, page, &header);
+    account_latency(ring, start);
+    if (OSAL_SUCCESS != status)
+      break;
+  }
+
+  return i;
+}
+
+/**
+ * @brief   Find the first page of session written at or after the
+ *          specified UTC time.
+ * @details Requested time gets converted to boot time of the session,
+ *          which never goes back inside session. Then the last block
+ *          starting before that time is bisected over page 0 headers and
+ *          the page is bisected inside that block.
+ * @note    Bus must be locked by caller.
+ * @return  OSAL_FAILED if session ended before the requested time.
+ */
+static bool seek_time(NandRing *ring, const NandRingSession *session,
+                      uint64_t utc_us, uint32_t *blk, uint32_t *page) {
+
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  const uint64_t correction = (uint64_t)session->utc_correction * 1000000;
+  const uint64_t t = (utc_us > correction) ? (utc_us - correction) : 0;
+  uint32_t lo, hi, found;
+  uint64_t time;
+
+  *blk = session->first_blk;
+  *page = 0;
+  if (t <= session->time_boot_us)
+    return OSAL_SUCCESS;
+
+  /* the last block starting before requested time */
+  *blk = session_blk(ring, session, seek_time_pos(ring, session, t));
+
+  /* the last page written before requested time */
+  lo = 0;
+  hi = (*blk == session->last_blk) ? session->last_page : (ppb - 1);
+  const uint32_t last_page = hi;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (probe_page(ring, *blk, mid, hi, &found, &time) && (time < t))
+      lo = found;
+    else
+      hi = mid - 1;
+  }
+
+  if (lo < last_page) {
+    *page = lo + 1;
+    return OSAL_SUCCESS;
+  }
+  if (*blk == session->last_blk)
+    return OSAL_FAILED;
+  *blk = next_good(ring, *blk);
+  *page = 0;
+  return OSAL_SUCCESS;
+}
+
+/**
+ * @brief   Read page data and header checking data against ECC stored
+ *          in header.
+ * @details Single bit error gets corrected in place.
+ * @note    Bus must be locked by caller.
+ */
+static nand_ring_read_t read_page(NandRing *ring, uint32_t blk, uint32_t page,
+                                  uint8_t *data, NandPageHeader *header) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  uint32_t ecc;
+
+  if (! page_header(ring, blk, page, header))
+    return NAND_RING_READ_NO_DATA;
+
+  nandReadPageData(nandp, blk, page, data, pds, &ecc);
+  ring->dbg.pages_read++;
+
+  switch (softecc_correct(data, pds, header->page_ecc, ecc)) {
+  case SOFTECC_CLEAN:
+    return NAND_RING_READ_OK;
+  case SOFTECC_CORRECTED:
+    ring->dbg.ecc_corrected++;
+    return NAND_RING_READ_CORRECTED;
+  default:
+    ring->dbg.ecc_uncorrectable++;
+    return NAND_RING_READ_ECC_FAILED;
+  }
+}
+
+/**
+ * @brief   Read page at cursor position into buffer and advance cursor.
+ * @note    Bus is locked, so cursor can run alongside log writer.
+ */
+static void cursor_read(NandRingCursor *cur, size_t idx) {
+
+  NANDDriver *nandp = cur->ring->config->nandp;
+  const NandPageHeader *header = &cur->header[idx];
+
+  /* block summary pages hold no session data */
+  do {
+    if (cur->end) {
+      cur->status[idx] = NAND_RING_READ_END;
+      return;
+    }
+
+    nandAcquireBus(nandp);
+    cur->status[idx] = read_page(cur->ring, cur->blk, cur->page,
+                                 cur->buf[idx], &cur->header[idx]);
+    nandReleaseBus(nandp);
+
+    /* writer erased or reused the block after cursor was started */
+    if ((NAND_RING_READ_NO_DATA == cur->status[idx]) ?
+        header_erased(header) : (header->id != cur->id)) {
+      cur->status[idx] = NAND_RING_READ_OVERWRITTEN;
+      cur->end = true;
+      return;
+    }
+    cur->id++;
+
+    if ((cur->blk == cur->last_blk) && (cur->page == cur->last_page))
+      cur->end = true;
+    else
+      nandRingNextPage(cur->ring, &cur->blk, &cur->page);
+  } while ((NAND_RING_READ_NO_DATA != cur->status[idx])
+           && (NAND_RING_SUMMARY_PAGE == header->first_record));
+}
+
+/**
+ * @brief   Read-ahead worker keeps both cursor buffers filled.
+ */
+static THD_FUNCTION(CursorWorker, arg) {
+  chRegSetThreadName("NandCursor");
+  NandRingCursor *cur = arg;
+  size_t idx = 0;
+
+  while (true) {
+    chSemWait(&cur->empty);
+    if (cur->stop)
+      break;
+    cursor_read(cur, idx);
+    chSemSignal(&cur->full);
+    idx ^= 1;
+  }
+
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Id of session page. Blocks are written from page 0 without
+ *          gaps, so single header read is enough.
+ * @note    Bus must be locked by caller.
+ */
+static uint64_t session_page_id(NandRing *ring,
+                                const NandRingSession *session,
+                                uint32_t blk, uint32_t page) {
+
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  NandPageHeader header;
+  uint64_t id = session->id + page;
+  uint32_t b = session->first_blk;
+
+  if (blk == b)
+    return id;
+  if (page_header(ring, blk, 0, &header))
+    return header.id + page;
+
+  /* damaged header, all blocks of session except the last one are full */
+  for (size_t i=0; (b != blk) && (i < ring->config->len); i++) {
+    b = next_good(ring, b);
+    id += ppb;
+  }
+
+  return id;
+}
+
+/**
+ * @brief   Set cursor to page of session and start read-ahead worker.
+ */
+static void cursor_start(NandRingCursor *cur, NandRing *ring,
+                         const NandRingSession *session, uint32_t blk,
+                         uint32_t page, uint64_t id, uint8_t *buffers,
+                         void *wa, size_t wa_size) {
+
+  const size_t pds = ring->config->nandp->config->page_data_size;
+
+  cur->ring = ring;
+  cur->blk = blk;
+  cur->page = page;
+  cur->id = id;
+  cur->last_blk = session->last_blk;
+  cur->last_page = session->last_page;
+  cur->end = false;
+  cur->buf[0] = buffers;
+  cur->buf[1] = &buffers[pds];
+  cur->front = 0;
+  cur->holding = false;
+  cur->stop = false;
+  cur->worker = NULL;
+  chSemObjectInit(&cur->empty, 2);
+  chSemObjectInit(&cur->full, 0);
+
+  if (NULL != wa) {
+    cur->worker = chThdCreateStatic(wa, wa_size, chThdGetPriorityX() + 1,
+                                    CursorWorker, cur);
+  }
+}
+
+/**
+ * @brief   Last block and page holding valid header.
+ * @return  False if ring holds no data.
+ */
+static bool head_position(NandRing *ring, uint32_t *blk, uint32_t *page) {
+
+  if (PAGE_ID_FIRST == ring->cur_id)
+    return false;
+
+  if ((BLOCK_NOT_FOUND != ring->head_blk)
+      && ! nandIsBad(ring->config->nandp, ring->head_blk)) {
+    *blk = ring->head_blk;
+    *page = ring->head_page;
+    return true;
+  }
+
+  *blk = last_written_block(ring);
+  if (BLOCK_NOT_FOUND == *blk)
+    return false;
+  *page = last_written_page_search(ring, *blk);
+  return true;
+}
+
+/**
+ * @brief   Logical position of the oldest block with readable header.
+ * @details Ring which has not wrapped yet starts with run of erased
+ *          blocks, so the first position where probing succeeds is
+ *          bisected.
+ */
+static bool oldest_pos(NandRing *ring, uint32_t last, uint32_t *pos) {
+
+  NandPageHeader header;
+  uint32_t lo = 0;
+  uint32_t hi = last;
+  uint32_t found;
+
+  if (probe_logical(ring, 0, last, true, pos, &header))
+    return true;
+  if (! probe_logical(ring, hi, hi, true, &found, &header))
+    return false;
+  *pos = found;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if (probe_logical(ring, mid, hi, true, &found, &header)) {
+      *pos = found;
+      hi = mid;
+    }
+    else {
+      lo = mid + 1;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief   Find page with specified id.
+ * @details Ids of page 0 headers grow along the ring starting from the
+ *          oldest written block, so the last block with id not greater
+ *          than the requested one is bisected between it and the head.
+ *          Page inside block is computed directly because ids of block
+ *          pages are consecutive. Wasted headers are stepped over by
+ *          local probing like during mount.
+ * @note    Falls back to scanning page 0 of every block when the result
+ *          could not be confirmed.
+ * @note    Bus must be locked by caller.
+ * @return  OSAL_FAILED if page with such id is not in ring anymore.
+ */
+static bool seek_id(NandRing *ring, uint64_t id, uint32_t *blk,
+                    uint32_t *page) {
+
+  if ((PAGE_ID_WASTED == id) || (id >= ring->cur_id))
+    return OSAL_FAILED;
+
+  uint32_t head_blk, head_page;
+  uint32_t lo, hi;
+  uint64_t lo_id;
+  uint32_t found;
+  NandPageHeader header;
+
+  /* unwrapped ring starts with run of erased blocks */
+  if (! head_position(ring, &head_blk, &head_page))
+    goto BRUTE;
+  hi = logical_pos(ring, head_blk);
+  if (! oldest_pos(ring, hi, &lo)
+      || ! probe_logical(ring, lo, hi, false, &lo, &header))
+    goto BRUTE;
+  lo_id = header.id;
+  /* older than the oldest page in ring */
+  if (lo_id > id)
+    return OSAL_FAILED;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (probe_logical(ring, mid, hi, false, &found, &header)
+        && (header.id <= id)) {
+      lo = found;
+      lo_id = header.id;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+
+  *blk = logical_blk(ring, lo);
+  if (seek_in_block(ring, *blk, lo_id, id, page))
+    return OSAL_SUCCESS;
+
+BRUTE:
+  if (seek_id_brute(ring, id, blk, page))
+    return OSAL_SUCCESS;
+  return OSAL_FAILED;
+}
+
+/**
+ * @brief   First block of session whose pages point to back_link.
+ * @details Session starts right after back_link block while that block
+ *          still holds older data. Once it got erased or overwritten,
+ *          possibly by the session itself, the beginning of session is
+ *          overwritten too and session starts at the oldest readable
+ *          block.
+ * @param[in] id      id of any page of session
+ */
+static uint32_t session_first_blk(NandRing *ring, uint32_t back_link,
+                                  uint64_t id, uint32_t last_pos) {
+
+  NandPageHeader header;
+  bool overwritten = false;
+  uint32_t pos;
+
+  if (! nandIsBad(ring->config->nandp, back_link)) {
+    if (page_header(ring, back_link, 0, &header))
+      overwritten = (header.id >= id) || (header.back_link == back_link);
+    else
+      overwritten = header_erased(&header);
+  }
+
+  if (overwritten && oldest_pos(ring, last_pos, &pos))
+    return logical_blk(ring, pos);
+  return next_good(ring, back_link);
+}
+
+/**
+ * @brief   Read session starting at first_blk.
+ * @details Its last block is bisected as the last one between first
+ *          block and head still pointing to the same back link.
+ */
+static bool session_at(NandRing *ring, uint32_t first_blk,
+                       NandRingSession *session) {
+
+  NandPageHeader hdr_first, hdr_last, header;
+  uint32_t head_blk, head_page;
+  uint32_t found;
+
+  if (! head_position(ring, &head_blk, &head_page)
+      || ! page_header(ring, first_blk, 0, &hdr_first))
+    return OSAL_FAILED;
+
+  uint32_t lo = logical_pos(ring, first_blk);
+  uint32_t hi = logical_pos(ring, head_blk);
+  if (lo > hi)
+    return OSAL_FAILED;
+
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (probe_logical(ring, mid, hi, false, &found, &header)
+        && (header.back_link == hdr_first.back_link))
+      lo = found;
+    else
+      hi = mid - 1;
+  }
+
+  const uint32_t last_blk = logical_blk(ring, lo);
+  const uint32_t last_page = (last_blk == head_blk) ? head_page :
+                             last_written_page_search(ring, last_blk);
+  if (! page_header(ring, last_blk, last_page, &hdr_last))
+    return OSAL_FAILED;
+
+  session->id = hdr_first.id;
+  session->time_boot_us = hdr_first.time_boot_us;
+  session->utc_correction = hdr_last.utc_correction;
+  session->first_blk = first_blk;
+  session->last_blk = last_blk;
+  session->last_page = last_page;
+  session->pages = hdr_last.id - hdr_first.id + 1;
+  return OSAL_SUCCESS;
+}
+
+/**
+ * @brief   Read the oldest session still present in ring.
+ */
+static bool session_oldest(NandRing *ring, NandRingSession *session) {
+
+  uint32_t head_blk, head_page, pos;
+
+  if (! head_position(ring, &head_blk, &head_page)
+      || ! oldest_pos(ring, logical_pos(ring, head_blk), &pos))
+    return OSAL_FAILED;
+
+  return session_at(ring, logical_blk(ring, pos), session);
+}
+
+/**
+ * @brief   Read the newest session.
+ */
+static bool session_newest(NandRing *ring, NandRingSession *session) {
+
+  uint32_t head_blk, head_page;
+  NandPageHeader header;
+
+  if (! head_position(ring, &head_blk, &head_page)
+      || ! page_header(ring, head_blk, head_page, &header))
+    return OSAL_FAILED;
+
+  return session_at(ring, session_first_blk(ring, header.back_link, header.id,
+                                            logical_pos(ring, head_blk)),
+                    session);
+}
+
+/**
+ * @brief   Read session written right after the specified one.
+ */
+static bool session_newer(NandRing *ring, const NandRingSession *current,
+                          NandRingSession *session) {
+
+  uint32_t head_blk, head_page, pos;
+  NandPageHeader header;
+
+  if (! head_position(ring, &head_blk, &head_page))
+    return OSAL_FAILED;
+  const uint32_t head_pos = logical_pos(ring, head_blk);
+  const uint32_t last_pos = logical_pos(ring, current->last_blk);
+  if ((last_pos >= head_pos)
+      || ! probe_logical(ring, last_pos + 1, head_pos, false, &pos, &header))
+    return OSAL_FAILED;
+
+  return session_at(ring, logical_blk(ring, pos), session);
+}
+
+/**
+ * @brief   Read session written right before the specified one.
+ */
+static bool session_older(NandRing *ring, const NandRingSession *current,
+                          NandRingSession *session) {
+
+  NandPageHeader hdr_first, hdr_back;
+
+  if (! page_header(ring, current->first_blk, 0, &hdr_first))
+    return OSAL_FAILED;
+
+  const uint32_t back_link = hdr_first.back_link;
+  const uint32_t back_pos = logical_pos(ring, back_link);
+  if ((back_link < ring->config->start_blk)
+      || (back_link >= ring->config->start_blk + ring->config->len)
+      || (back_pos >= logical_pos(ring, current->first_blk))
+      || nandIsBad(ring->config->nandp, back_link)
+      || ! page_header(ring, back_link, 0, &hdr_back)
+      || (hdr_back.id >= current->id))
+    return OSAL_FAILED;
+
+  return session_at(ring, session_first_blk(ring, hdr_back.back_link,
+                                            hdr_back.id, back_pos),
+                    session);
 }
 
 /**
- * @brief fill_session
- * @param hdr_first
- * @param hdr_last
- * @param result
+ * @brief   Ring state allowing readers, writer may be running.
  */
-static void fill_session(const NandRingIterator *it,
-                         const NandPageHeader *hdr_first,
-                         const NandPageHeader *hdr_last,
-                         uint32_t first_blk,
-                         NandRingSession *result) {
-
-  result->id = hdr_first->id;
-  result->time_boot_us = hdr_first->time_boot_us;
-  result->utc_correction = hdr_last->utc_correction;
-  result->first_blk = first_blk;
-  result->last_blk = it->last_blk;
-  result->last_page = last_written_page(it->ring, it->last_blk);
+static bool ring_readable(const NandRing *ring) {
+  return (NAND_RING_MOUNTED == ring->state)
+      || (NAND_RING_ITERATOR_BOUNDED == ring->state)
+      || (NAND_RING_NO_SPACE == ring->state);
 }
 
 /**
@@ -454,6 +2143,16 @@ void nandRingObjectInit(NandRing *ring) {
   ring->state = NAND_RING_UNINIT;
   ring->utc_correction = 0;
   ring->cur_back_link = -1;
+  ring->cp_blk = BLOCK_NOT_FOUND;
+  ring->cp_page = 0;
+  ring->cp_countdown = 0;
+  ring->total_good = 0;
+  ring->erased_ahead = 0;
+  ring->head_blk = BLOCK_NOT_FOUND;
+  ring->head_page = 0;
+  ring->st_oldest = 0;
+  ring->st_count = 0;
+  ring->st_open = false;
 
   reset_debug(ring);
   /* other fields will be initialized during start() */
@@ -475,10 +2174,25 @@ void nandRingStart(NandRing *ring, const NandRingConfig *config, uint8_t *workin
   osalDbgCheck(config->len >= MIN_RING_SIZE);
   osalDbgAssert(sizeof(NandPageHeader) <= config->nandp->config->page_spare_size,
                 "Not enough room in spare area");
+  if (config->checkpoint_len > 0) {
+    osalDbgCheck((config->checkpoint_len >= 2) && (config->checkpoint_period > 0));
+    osalDbgAssert((config->checkpoint_blk + config->checkpoint_len) <= config->nandp->config->blocks,
+                  "NAND overflow");
+    osalDbgAssert(((config->checkpoint_blk + config->checkpoint_len) <= config->start_blk)
+                  || (config->checkpoint_blk >= (config->start_blk + config->len)),
+                  "Checkpoint area overlaps ring");
+  }
+  osalDbgCheck(config->erase_ahead < SEARCH_PROBE_WINDOW);
 
   ring->config = config;
   ring->state = NAND_RING_IDLE;
   ring->wa = working_area;
+  ring->total_good = get_total_good(ring);
+  ring->cp_blk = BLOCK_NOT_FOUND;
+  if (config->checkpoint_len > 0) {
+    ring->cp_blk = cp_next_good(ring, BLOCK_NOT_FOUND);
+    ring->cp_page = config->nandp->config->pages_per_block;
+  }
   /* other fields will be initialized during mount() */
 }
 
@@ -490,12 +2204,26 @@ bool nandRingMount(NandRing *ring) {
   osalDbgCheck(NULL != ring);
   osalDbgCheck(NAND_RING_IDLE == ring->state);
 
-  if (get_total_good(ring) < (ring->config->len / 2)) {
+  /* session table gets rebuilt after head is found */
+  ring->st_count = 0;
+  ring->st_open = false;
+
+  /* bad block map could be changed by somebody else while ring was idle */
+  ring->total_good = get_total_good(ring);
+  if (ring->total_good < (ring->config->len / 2)) {
     return OSAL_FAILED;
   }
 
-  const uint32_t last_blk  = last_written_block(ring);
+  uint32_t last_blk;
+  if (cp_last_written_block(ring, &last_blk)) {
+    ring->dbg.checkpoint_hit++;
+  }
+  else {
+    last_blk = last_written_block(ring);
+  }
+
   if (BLOCK_NOT_FOUND == last_blk) {
+    ring->head_blk = BLOCK_NOT_FOUND;
     ring->cur_blk = mkfs(ring);
     ring->cur_page = 0;
     ring->cur_id = PAGE_ID_FIRST;
@@ -509,13 +2237,20 @@ bool nandRingMount(NandRing *ring) {
     }
     else {
       ring->cur_blk = close_prev_session(ring, last_blk, last_page);
+      set_closed_head(ring, last_blk, last_page);
       ring->cur_page = 0;
       ring->cur_id = header.id + 1;
       ring->cur_back_link = last_blk;
     }
   }
 
+  /* reserve left by previous session is unknown, it will be refilled */
+  ring->erased_ahead = 0;
+  cp_write(ring);
   ring->state = NAND_RING_MOUNTED;
+  if (NULL != ring->config->sessions)
+    table_build(ring);
+  ring->dbg.mount_spare_reads = ring->dbg.spare_reads;
   return OSAL_SUCCESS;
 }
 
@@ -523,74 +2258,115 @@ bool nandRingMount(NandRing *ring) {
  * @brief   Flush data to NAND page and seal it using spare area.
  * @note    Buffer must be the same size as page data.
  * @note    This function able to write only single whole page at time.
+ * @note    Does not take NAND bus. Writer holds it when readers run in
+ *          other threads, like NandLog worker does.
  */
 bool nandRingWritePage(NandRing *ring, const uint8_t *data) {
 
-  osalDbgCheck((NULL != data) && (NULL != ring));
-  if (NAND_RING_NO_SPACE == ring->state)
+  osalDbgCheck(NULL != data);
+
+  if (1 == write_batch(ring, NULL, data, NULL, NULL, 1))
+    return OSAL_SUCCESS;
+  else
     return OSAL_FAILED;
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+}
 
-  NANDDriver *nandp = ring->config->nandp;
-  const size_t ppb = nandp->config->pages_per_block;
-  const size_t pds = nandp->config->page_data_size;
-  uint32_t page_ecc;
-  uint8_t status = NAND_STATUS_FAILED;
+/**
+ * @brief   Write contiguous run of pages.
+ * @details Block boundaries and bad block rescue handled internally,
+ *          every page gets time stamp of its own write.
+ * @note    Buffer must be npages times the page data size.
+ * @return  Number of successfully written pages. Less than requested
+ *          means ring has no space left.
+ */
+size_t nandRingWritePages(NandRing *ring, const uint8_t *data, size_t npages) {
 
-  /* write page data */
-RETRY:
-  status = nandWritePageData(nandp, ring->cur_blk, ring->cur_page,
-                             data, pds, &page_ecc);
-  if (nandFailed(status)) {
-    nandMarkBad(nandp, ring->cur_blk);
-    ring->dbg.new_badblocks++;
-    ring->dbg.write_data_failed++;
-    const uint32_t b = block_data_rescue(ring, ring->cur_blk, ring->cur_page);
-    if (BLOCK_NOT_FOUND == b)
-      goto NO_SPACE;
-    else
-      ring->cur_blk = b;
-    goto RETRY;
-  }
+  osalDbgCheck(NULL != data);
 
-  /* seal page using spare area */
-  NandPageHeader header;
-  fill_header(ring, &header, page_ecc, pds);
-  status = nandWritePageSpare(nandp, ring->cur_blk, ring->cur_page,
-                              (uint8_t *)&header, sizeof(NandPageHeader));
-  if (nandFailed(status)) {
-    nandMarkBad(nandp, ring->cur_blk);
-    ring->dbg.new_badblocks++;
-    ring->dbg.write_spare_failed++;
-    const uint32_t b = block_data_rescue(ring, ring->cur_blk, ring->cur_page);
-    if (BLOCK_NOT_FOUND == b)
-      goto NO_SPACE;
-    else
-      ring->cur_blk = b;
-    goto RETRY;
+  return write_batch(ring, NULL, data, NULL, NULL, npages);
+}
+
+/**
+ * @brief   Same as nandRingWritePages() but for scattered page buffers.
+ * @param[in] written   number of useful bytes in every page stored in
+ *                      page header. Set to NULL for full pages.
+ * @param[in] first     offset of the first record starting in every
+ *                      page. Set to NULL for unframed data.
+ */
+size_t nandRingWritePagesv(NandRing *ring, const uint8_t * const *pages,
+                           const uint16_t *written, const uint16_t *first,
+                           size_t npages) {
+
+  osalDbgCheck(NULL != pages);
+
+  return write_batch(ring, pages, NULL, written, first, npages);
+}
+
+/**
+ * @brief   Erase single block of erase-ahead reserve if it is not full.
+ * @details Intended to be called from the writer thread in idle time
+ *          between pages.
+ * @return  Number of blocks still missing in reserve.
+ */
+size_t nandRingEraseAhead(NandRing *ring) {
+
+  osalDbgCheck(NULL != ring);
+  if (NAND_RING_MOUNTED != ring->state)
+    return 0;
+
+  if (ring->erased_ahead < ring->config->erase_ahead) {
+    uint32_t tail = ring->cur_blk;
+    for (size_t i=0; i<ring->erased_ahead; i++) {
+      tail = next_good(ring, tail);
+    }
+    /* reserve must never wrap onto head itself */
+    if (next_good(ring, tail) == ring->cur_blk)
+      return 0;
+
+    const uint32_t b = erase_next(ring, tail);
+    if ((BLOCK_NOT_FOUND == b) || (b == ring->cur_blk))
+      return 0;
+    ring->erased_ahead++;
   }
 
-  /* prepare next iteration */
-  ring->cur_id++;
-  ring->cur_page++;
-  if (ring->cur_page == ppb) {
-    ring->cur_page = 0;
-    const uint32_t b = erase_next(ring, ring->cur_blk);
-    if (BLOCK_NOT_FOUND == b)
-      goto NO_SPACE;
-    else
-      ring->cur_blk = b;
+  return ring->config->erase_ahead - ring->erased_ahead;
+}
+
+/**
+ * @brief   Write latency percentile since mount.
+ * @param[in] percent   percentile to calculate, 100 gives maximum.
+ * @return  Upper bound of latency in microseconds.
+ */
+uint32_t nandRingWriteLatency(const NandRing *ring, uint32_t percent) {
+
+  osalDbgCheck((NULL != ring) && (percent <= 100));
+
+  if (100 == percent)
+    return ring->dbg.write_latency_max_us;
+
+  uint32_t total = 0;
+  for (size_t i=0; i<NAND_RING_LATENCY_BUCKETS; i++) {
+    total += ring->dbg.write_latency_hist[i];
   }
 
-  return OSAL_SUCCESS;
+  const uint64_t threshold = ((uint64_t)total * percent + 99) / 100;
+  uint32_t acc = 0;
+  for (size_t i=0; i<NAND_RING_LATENCY_BUCKETS - 1; i++) {
+    acc += ring->dbg.write_latency_hist[i];
+    if (acc >= threshold) {
+      const uint32_t bound = (i + 1) * NAND_RING_LATENCY_STEP_US;
+      return (bound < ring->dbg.write_latency_max_us) ?
+             bound : ring->dbg.write_latency_max_us;
+    }
+  }
 
-NO_SPACE:
-  ring->state = NAND_RING_NO_SPACE;
-  return OSAL_FAILED;
+  return ring->dbg.write_latency_max_us;
 }
 
 /**
  * @brief   Calculate total amount of available good blocks
+ * @note    Mounted ring returns cached value, idle ring recounts blocks
+ *          because bad block map could be changed externally.
  */
 uint32_t nandRingTotalGood(const NandRing *ring) {
 
@@ -598,7 +2374,10 @@ uint32_t nandRingTotalGood(const NandRing *ring) {
   osalDbgCheck((NAND_RING_MOUNTED == ring->state)
                || (NAND_RING_IDLE == ring->state));
 
-  return get_total_good(ring);
+  if (NAND_RING_MOUNTED == ring->state)
+    return ring->total_good;
+  else
+    return get_total_good(ring);
 }
 
 /**
@@ -622,6 +2401,412 @@ void nandRingSetUtcCorrection(NandRing *ring, uint32_t correction) {
   ring->utc_correction = correction;
 }
 
+/**
+ * @brief   Read and check header of any page in ring.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  True when header CRC is valid.
+ */
+bool nandRingPageHeader(NandRing *ring, uint32_t blk, uint32_t page,
+                        NandPageHeader *header) {
+
+  osalDbgCheck((NULL != ring) && (NULL != header));
+  osalDbgCheck((NAND_RING_UNINIT != ring->state) && (NAND_RING_STOP != ring->state));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = page_header(ring, blk, page, header);
+  nandReleaseBus(nandp);
+
+  return ret;
+}
+
+/**
+ * @brief   Find page with specified id.
+ * @details Bisects page 0 headers, see seek_id().
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  OSAL_FAILED if page with such id is not in ring anymore.
+ */
+bool nandRingSeekId(NandRing *ring, uint64_t id, uint32_t *blk, uint32_t *page) {
+
+  osalDbgCheck((NULL != ring) && (NULL != blk) && (NULL != page));
+  osalDbgCheck(ring_readable(ring));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = seek_id(ring, id, blk, page);
+  nandReleaseBus(nandp);
+
+  return ret;
+}
+
+/**
+ * @brief   UTC time of page in microseconds.
+ * @details Correction of the session is used for all its pages, because
+ *          pages written before the correction got known carry zero.
+ *          Correction is the UTC time of boot in seconds.
+ */
+uint64_t nandRingPageTime(const NandRingSession *session,
+                          const NandPageHeader *header) {
+
+  osalDbgCheck((NULL != session) && (NULL != header));
+
+  return (uint64_t)session->utc_correction * 1000000 + header->time_boot_us;
+}
+
+/**
+ * @brief   Find the first page of session written at or after the
+ *          specified UTC time.
+ * @details Bisects session blocks and then pages, see seek_time().
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @param[in] utc_us  UTC time in microseconds, see nandRingPageTime()
+ * @return  OSAL_FAILED if session ended before the requested time.
+ */
+bool nandRingSeekTime(NandRing *ring, const NandRingSession *session,
+                      uint64_t utc_us, uint32_t *blk, uint32_t *page) {
+
+  osalDbgCheck((NULL != ring) && (NULL != session)
+               && (NULL != blk) && (NULL != page));
+  osalDbgCheck((NAND_RING_UNINIT != ring->state) && (NAND_RING_STOP != ring->state));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = seek_time(ring, session, utc_us, blk, page);
+  nandReleaseBus(nandp);
+
+  return ret;
+}
+
+/**
+ * @brief   Read summary of block written in summary mode.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  OSAL_FAILED if block has no valid summary, like the block
+ *          being written or the last block of session.
+ */
+bool nandRingBlockSummary(NandRing *ring, uint32_t blk,
+                          NandBlockSummary *summary) {
+
+  osalDbgCheck((NULL != ring) && (NULL != summary));
+  osalDbgCheck((NAND_RING_UNINIT != ring->state) && (NAND_RING_STOP != ring->state));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool valid = block_summary(ring, blk, summary);
+  nandReleaseBus(nandp);
+
+  return valid ? OSAL_SUCCESS : OSAL_FAILED;
+}
+
+/**
+ * @brief   Merge summaries of session blocks overlapping UTC time range.
+ * @details The first block is bisected like in nandRingSeekTime(), then
+ *          session is walked reading single summary per block until the
+ *          block starting after the range. Boundary blocks are counted
+ *          whole. Range from 0 to UINT64_MAX sizes the whole session.
+ * @note    Takes NAND bus for every block, so it may run alongside the
+ *          writer.
+ * @param[out] total  merged summary, first_id is 0 when nothing found
+ * @return  Number of blocks in range without valid summary. Caller has
+ *          to read their pages to get exact counts.
+ */
+size_t nandRingSummaryRange(NandRing *ring, const NandRingSession *session,
+                            uint64_t from_utc_us, uint64_t to_utc_us,
+                            NandBlockSummary *total) {
+
+  osalDbgCheck((NULL != ring) && (NULL != session) && (NULL != total));
+  osalDbgCheck(ring_readable(ring));
+
+  NANDDriver *nandp = ring->config->nandp;
+  const uint32_t len = ring->config->len;
+  const uint64_t correction = (uint64_t)session->utc_correction * 1000000;
+  const uint64_t from = (from_utc_us > correction) ? (from_utc_us - correction) : 0;
+  const uint64_t to = (to_utc_us > correction) ? (to_utc_us - correction) : 0;
+  const uint32_t last = (session->last_blk - session->first_blk + len) % len;
+  NandBlockSummary summary;
+  NandPageHeader header;
+  uint32_t pos = 0;
+  size_t missing = 0;
+
+  memset(total, 0, sizeof(NandBlockSummary));
+
+  nandAcquireBus(nandp);
+  if (from > session->time_boot_us)
+    pos = seek_time_pos(ring, session, from);
+  nandReleaseBus(nandp);
+
+  for (; pos <= last; pos++) {
+    const uint32_t blk = session_blk(ring, session, pos);
+    if (nandIsBad(nandp, blk))
+      continue;
+
+    nandAcquireBus(nandp);
+    const bool valid = block_summary(ring, blk, &summary);
+    const bool started = valid || page_header(ring, blk, 0, &header);
+    nandReleaseBus(nandp);
+
+    if (! valid) {
+      if (started && (header.time_boot_us > to))
+        break;
+      missing++;
+    }
+    else if (summary.time_min_us > to) {
+      break;
+    }
+    else if (summary.time_max_us >= from) {
+      summary_merge(total, &summary);
+    }
+  }
+
+  return missing;
+}
+
+/**
+ * @brief   Read page data and header checking data against ECC stored
+ *          in header.
+ * @details Single bit error gets corrected in place.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @param[out] data     buffer of page data size
+ * @param[out] header   header of page
+ */
+nand_ring_read_t nandRingReadPage(NandRing *ring, uint32_t blk, uint32_t page,
+                                  uint8_t *data, NandPageHeader *header) {
+
+  osalDbgCheck((NULL != ring) && (NULL != data) && (NULL != header));
+  osalDbgCheck((NAND_RING_UNINIT != ring->state) && (NAND_RING_STOP != ring->state));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const nand_ring_read_t ret = read_page(ring, blk, page, data, header);
+  nandReleaseBus(nandp);
+
+  return ret;
+}
+
+/**
+ * @brief   Advance position to the next page in write order skipping
+ *          bad blocks and wrapping at the ring end.
+ */
+void nandRingNextPage(const NandRing *ring, uint32_t *blk, uint32_t *page) {
+
+  osalDbgCheck((NULL != ring) && (NULL != blk) && (NULL != page));
+
+  (*page)++;
+  if (*page == ring->config->nandp->config->pages_per_block) {
+    *page = 0;
+    *blk = next_good(ring, *blk);
+  }
+}
+
+/**
+ * @brief   Prepare cursor streaming all pages of session.
+ * @param[in] buffers   two page data sizes long
+ * @param[in] wa        working area for read-ahead worker declared using
+ *                      THD_WORKING_AREA(wa, NAND_RING_CURSOR_STACK).
+ *                      Set to NULL for reading in caller thread.
+ * @note    Worker runs one priority level above caller, so the next read
+ *          gets issued as soon as the previous one completes.
+ */
+void nandRingCursorStart(NandRingCursor *cur, NandRing *ring,
+                         const NandRingSession *session, uint8_t *buffers,
+                         void *wa, size_t wa_size) {
+
+  osalDbgCheck((NULL != cur) && (NULL != ring) && (NULL != session)
+               && (NULL != buffers));
+
+  cursor_start(cur, ring, session, session->first_blk, 0, session->id,
+               buffers, wa, wa_size);
+}
+
+/**
+ * @brief   Prepare cursor streaming session pages starting from the first
+ *          one written at or after the specified UTC time.
+ * @details Caller stops reading when page time passes the end of
+ *          interval of interest.
+ * @return  OSAL_FAILED and cursor left unstarted if session ended before
+ *          the requested time.
+ */
+bool nandRingCursorStartTime(NandRingCursor *cur, NandRing *ring,
+                             const NandRingSession *session, uint64_t utc_us,
+                             uint8_t *buffers, void *wa, size_t wa_size) {
+
+  osalDbgCheck((NULL != cur) && (NULL != ring) && (NULL != session)
+               && (NULL != buffers));
+  NANDDriver *nandp = ring->config->nandp;
+  uint32_t blk, page;
+  uint64_t id = 0;
+
+  nandAcquireBus(nandp);
+  const bool found = seek_time(ring, session, utc_us, &blk, &page);
+  if (OSAL_SUCCESS == found)
+    id = session_page_id(ring, session, blk, page);
+  nandReleaseBus(nandp);
+  if (OSAL_SUCCESS != found)
+    return OSAL_FAILED;
+
+  cursor_start(cur, ring, session, blk, page, id, buffers, wa, wa_size);
+  return OSAL_SUCCESS;
+}
+
+/**
+ * @brief   Get the next page of session.
+ * @details Page data stays valid until the next call.
+ * @param[out] data     page data, NULL at the end of session
+ * @param[out] header   page header, may be NULL
+ * @return  Read status of returned page, NAND_RING_READ_END or
+ *          NAND_RING_READ_OVERWRITTEN when the writer has caught up.
+ */
+nand_ring_read_t nandRingCursorNext(NandRingCursor *cur, const uint8_t **data,
+                                    NandPageHeader *header) {
+
+  osalDbgCheck((NULL != cur) && (NULL != data));
+  size_t idx = 0;
+
+  if (NULL == cur->worker) {
+    cursor_read(cur, idx);
+  }
+  else {
+    /* let worker refill buffer returned by previous call */
+    if (cur->holding)
+      chSemSignal(&cur->empty);
+    chSemWait(&cur->full);
+    idx = cur->front;
+    cur->front ^= 1;
+    cur->holding = true;
+  }
+
+  if (NAND_RING_READ_END == cur->status[idx]) {
+    *data = NULL;
+  }
+  else {
+    *data = cur->buf[idx];
+    if (NULL != header)
+      *header = cur->header[idx];
+  }
+  return cur->status[idx];
+}
+
+/**
+ * @brief   Stop read-ahead worker. Cursor may be stopped at any point.
+ */
+void nandRingCursorStop(NandRingCursor *cur) {
+
+  osalDbgCheck(NULL != cur);
+
+  if (NULL != cur->worker) {
+    cur->stop = true;
+    chSemSignal(&cur->empty);
+    chThdWait(cur->worker);
+    cur->worker = NULL;
+  }
+}
+
+/**
+ * @brief   Number of sessions in session table.
+ */
+size_t nandRingSessionCount(const NandRing *ring) {
+
+  osalDbgCheck(NULL != ring);
+
+  return ring->st_count;
+}
+
+/**
+ * @brief   Get session from session table without touching NAND.
+ * @param[in] idx   session number, 0 is the newest one
+ * @return  OSAL_FAILED if there is no such session in table.
+ */
+bool nandRingSessionGet(const NandRing *ring, size_t idx, NandRingSession *session) {
+
+  osalDbgCheck((NULL != ring) && (NULL != session));
+  bool ret = OSAL_FAILED;
+
+  osalSysLock();
+  if (idx < ring->st_count) {
+    *session = *table_entry(ring, ring->st_count - 1 - idx);
+    ret = OSAL_SUCCESS;
+  }
+  osalSysUnlock();
+
+  return ret;
+}
+
+/**
+ * @brief   Read the oldest session still present in ring.
+ * @note    Session partially overwritten by ring starts at its oldest
+ *          surviving block.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  OSAL_FAILED if ring is empty.
+ */
+bool nandRingSessionOldest(NandRing *ring, NandRingSession *session) {
+
+  osalDbgCheck((NULL != ring) && (NULL != session));
+  osalDbgCheck(ring_readable(ring));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = session_oldest(ring, session);
+  nandReleaseBus(nandp);
+  return ret;
+}
+
+/**
+ * @brief   Read the newest session, i.e. the one being written or the
+ *          previous one if nothing was written since mount.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  OSAL_FAILED if ring is empty.
+ */
+bool nandRingSessionNewest(NandRing *ring, NandRingSession *session) {
+
+  osalDbgCheck((NULL != ring) && (NULL != session));
+  osalDbgCheck(ring_readable(ring));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = session_newest(ring, session);
+  nandReleaseBus(nandp);
+  return ret;
+}
+
+/**
+ * @brief   Read session written right after the specified one.
+ * @details Next session starts in the first readable block after the
+ *          last block of current one.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  OSAL_FAILED if current session is the newest one.
+ */
+bool nandRingSessionNewer(NandRing *ring, const NandRingSession *current,
+                          NandRingSession *session) {
+
+  osalDbgCheck((NULL != ring) && (NULL != current) && (NULL != session));
+  osalDbgCheck(ring_readable(ring));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = session_newer(ring, current, session);
+  nandReleaseBus(nandp);
+  return ret;
+}
+
+/**
+ * @brief   Read session written right before the specified one.
+ * @details Back link of current session points to the last block of
+ *          previous one, which must be older than current session and
+ *          not overwritten yet.
+ * @note    Takes NAND bus, so it may run alongside the writer.
+ * @return  OSAL_FAILED if current session is the oldest one.
+ */
+bool nandRingSessionOlder(NandRing *ring, const NandRingSession *current,
+                          NandRingSession *session) {
+
+  osalDbgCheck((NULL != ring) && (NULL != current) && (NULL != session));
+  osalDbgCheck(ring_readable(ring));
+  NANDDriver *nandp = ring->config->nandp;
+
+  nandAcquireBus(nandp);
+  const bool ret = session_older(ring, current, session);
+  nandReleaseBus(nandp);
+  return ret;
+}
+
 /**
  * @brief nandRingErase
  * @param ring
@@ -635,6 +2820,10 @@ void nandRingErase(NandRing *ring) {
   NANDDriver *nandp  = ring->config->nandp;
 
   nandEraseRange(nandp, start, len);
+  if (ring->config->checkpoint_len > 0) {
+    nandEraseRange(nandp, ring->config->checkpoint_blk,
+                   ring->config->checkpoint_len);
+  }
 }
 
 /**
@@ -664,6 +2853,8 @@ void nandRingStop(NandRing *ring) {
 
 /**
  * @brief NandRingIteratorBind
+ * @note  Iterator never takes NAND bus, just like mount. Caller holds it
+ *        when other rings use the same NAND.
  * @param it
  * @param ring
  */
@@ -672,6 +2863,8 @@ void NandRingIteratorBind(NandRingIterator *it, NandRing *ring) {
   osalDbgCheck((NULL != it) && (NULL != ring));
   osalDbgCheck(NAND_RING_MOUNTED == ring->state);
 
+  it->spare_reads = 0;
+  it->forward = false;
   if (ring->cur_id == PAGE_ID_FIRST) {
     /* ring is empty */
     it->finished = true;
@@ -679,15 +2872,47 @@ void NandRingIteratorBind(NandRingIterator *it, NandRing *ring) {
   }
   else {
     it->finished = false;
-    it->last_blk = last_written_block(ring);
+    if ((BLOCK_NOT_FOUND != ring->head_blk)
+        && ! nandIsBad(ring->config->nandp, ring->head_blk)) {
+      /* head is known since mount, no need to search for it */
+      it->last_blk = ring->head_blk;
+      it->last_page = ring->head_page;
+    }
+    else {
+      const uint32_t reads = ring->dbg.spare_reads;
+      it->last_blk = last_written_block(ring);
+      it->last_page = LAST_PAGE_NOT_FOUND;
+      it->spare_reads = ring->dbg.spare_reads - reads;
+    }
   }
 
   ring->state = NAND_RING_ITERATOR_BOUNDED;
   it->ring = ring;
 }
 
+/**
+ * @brief   Bind iterator returning sessions from the oldest one to the
+ *          newest one.
+ * @details Every step starts from the session returned by the previous
+ *          one, so ring is not searched from the head again.
+ */
+void NandRingIteratorBindForward(NandRingIterator *it, NandRing *ring) {
+
+  osalDbgCheck((NULL != it) && (NULL != ring));
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  it->spare_reads = 0;
+  it->forward = true;
+  it->finished = (ring->cur_id == PAGE_ID_FIRST);
+  it->last_blk = -1;
+  ring->state = NAND_RING_ITERATOR_BOUNDED;
+  it->ring = ring;
+}
+
 /**
  * @brief NandRingIteratorNext
+ * @note  Does not take NAND bus in either direction, see
+ *        NandRingIteratorBind().
  * @param it
  * @param session
  */
@@ -696,17 +2921,37 @@ bool NandRingIteratorNext(NandRingIterator *it, NandRingSession *session) {
   osalDbgCheck((NULL != session) && (NULL != it) && (NULL != it->ring));
   NandRing *ring = it->ring;
   osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == ring->state);
+  const uint32_t reads = ring->dbg.spare_reads;
   if (it->finished) {
     goto ERROR;
   }
 
+  if (it->forward) {
+    bool status;
+    if (BLOCK_NOT_FOUND == it->last_blk)
+      status = session_oldest(ring, session);
+    else
+      status = session_newer(ring, &it->session, session);
+    if (OSAL_SUCCESS != status)
+      goto ERROR;
+    it->last_blk = session->last_blk;
+    it->session = *session;
+    it->spare_reads += ring->dbg.spare_reads - reads;
+    return OSAL_SUCCESS;
+  }
+
   NandPageHeader hdr_first, hdr_last, hdr_back;
   uint32_t last_blk;
   uint32_t first_blk;
   uint32_t last_page;
 
   last_blk = it->last_blk;
-  last_page = last_written_page(ring, last_blk);
+  last_page = it->last_page;
+  if (LAST_PAGE_NOT_FOUND == last_page) {
+    /* closed session block is a valid prefix followed by zeroed pages,
+       search falls back to brute force on anything else */
+    last_page = last_written_page_search(ring, last_blk);
+  }
   if (! page_header(ring, last_blk, last_page, &hdr_last)) {
     goto ERROR;
   }
@@ -731,8 +2976,10 @@ bool NandRingIteratorNext(NandRingIterator *it, NandRingSession *session) {
       || (hdr_first.back_link != hdr_last.back_link)) {
     goto ERROR;
   }
-  fill_session(it, &hdr_first, &hdr_last, first_blk, session);
+  fill_session(it, &hdr_first, &hdr_last, first_blk, last_page, session);
   it->last_blk = hdr_last.back_link; // prepare next iteration
+  it->last_page = LAST_PAGE_NOT_FOUND;
+  it->spare_reads += ring->dbg.spare_reads - reads;
   return OSAL_SUCCESS;
 
 
@@ -770,6 +3017,7 @@ bool NandRingIteratorNext(NandRingIterator *it, NandRingSession *session) {
 
 ERROR:
   it->finished = true;
+  it->spare_reads += ring->dbg.spare_reads - reads;
   return OSAL_FAILED;
 }
 
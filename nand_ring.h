@@ -1,6 +1,44 @@
 #ifndef NAND_RING_H_
 #define NAND_RING_H_
 
+/**
+ * @brief   Write latency histogram geometry. The last bucket collects
+ *          everything longer than the histogram span.
+ */
+#define NAND_RING_LATENCY_BUCKETS     32
+#define NAND_RING_LATENCY_STEP_US     100
+
+/**
+ * @brief   Version of on-flash structures, folded into their CRC seed.
+ * @details Pages, checkpoints and summaries of other versions fail CRC
+ *          check, so mount takes such ring for erased and formats it
+ *          from scratch. Old data is not readable after upgrade, offload
+ *          it before and call nandRingErase() to reclaim the ring at once.
+ *          Version 2 added NandPageHeader.first_record.
+ */
+#define NAND_RING_FORMAT_VERSION      2
+
+/**
+ * @brief   Page header first_record value for pages where no record starts.
+ */
+#define NAND_RING_NO_RECORD           0xFFFF
+
+/**
+ * @brief   Page header first_record value of block summary page.
+ */
+#define NAND_RING_SUMMARY_PAGE        0xFFFE
+
+/**
+ * @brief   Per type record counters in block summary. Types out of range
+ *          are counted in the last one.
+ */
+#define NAND_RING_SUMMARY_TYPES       8
+
+/**
+ * @brief   Stack size for read-ahead worker of session cursor.
+ */
+#define NAND_RING_CURSOR_STACK        256
+
 /**
  *
  */
@@ -22,7 +60,8 @@ typedef struct __attribute__((packed)) {
   /**
    * @brief     Correction for system boot time stamp.
    * @details   Used when no date/time was available during boot and was
-   *            acquired later, for example from GPS.
+   *            acquired later, for example from GPS. UTC time of
+   *            boot in seconds.
    */
   uint32_t    utc_correction;
   /**
@@ -35,16 +74,90 @@ typedef struct __attribute__((packed)) {
   uint32_t    back_link;
   /**
    * @brief     Number of actually written bytes in page.
-   * @details   Used during flush procedure and during "file" size estimation.
-   * @note      Currently unused.
+   * @details   Less than page data size for pages sealed by flush,
+   *            readers must ignore the rest of page data.
    */
   uint16_t    written;
+  /**
+   * @brief     Offset of the first record starting in this page.
+   * @details   NAND_RING_NO_RECORD when page does not contain record
+   *            start or data is not framed. Nonzero value means page
+   *            begins with continuation of previous record.
+   */
+  uint16_t    first_record;
   /**
    * @brief     Seal CRC for this structure
    */
   uint32_t    spare_crc;
 } NandPageHeader;
 
+/**
+ * @brief   Ring head position stored in checkpoint area.
+ */
+typedef struct __attribute__((packed)) {
+  /**
+   * @brief     NAND specific area for bad mark storing.
+   * @details   Must be always set to 0xFFFF i.e. erased.
+   */
+  uint16_t    bad_mark;
+  /**
+   * @brief     Id of page 0 in block pointed by cur_blk.
+   */
+  uint64_t    id;
+  /**
+   * @brief     Block currently written by ring.
+   */
+  uint32_t    cur_blk;
+  /**
+   * @brief     Last block number in _previous_ session.
+   */
+  uint32_t    back_link;
+  /**
+   * @brief     Seal CRC for this structure
+   */
+  uint32_t    crc;
+} NandRingCheckpoint;
+
+/**
+ * @brief   Block summary stored in the last page of block.
+ * @details Covers data pages of block, so range queries read single
+ *          page per block instead of page headers.
+ */
+typedef struct __attribute__((packed)) {
+  /**
+   * @brief     Ids of the first and the last data page.
+   */
+  uint64_t    first_id;
+  uint64_t    last_id;
+  /**
+   * @brief     Boot time range of data pages, see NandPageHeader.
+   */
+  uint64_t    time_min_us;
+  uint64_t    time_max_us;
+  /**
+   * @brief     Correction from the last data page.
+   */
+  uint32_t    utc_correction;
+  /**
+   * @brief     Records starting in block, counted by summary callback.
+   */
+  uint32_t    records;
+  uint32_t    types[NAND_RING_SUMMARY_TYPES];
+  /**
+   * @brief     Seal CRC for this structure
+   */
+  uint32_t    crc;
+} NandBlockSummary;
+
+/**
+ * @brief   Accounts data page in summary of block being written.
+ * @note    Header is the template of written page, its id and checksums
+ *          are not filled in whole page mode.
+ */
+typedef void (*nand_ring_summary_cb_t)(NandBlockSummary *summary,
+                                       const uint8_t *data,
+                                       const NandPageHeader *header);
+
 /**
  *
  */
@@ -55,6 +168,7 @@ typedef struct {
   uint16_t first_blk;
   uint16_t last_blk;          /* may be the same as first one */
   uint16_t last_page;
+  uint32_t pages;             /* pages with valid header */
 } NandRingSession;
 
 /**
@@ -70,13 +184,91 @@ typedef enum {
   NAND_RING_STOP
 } nand_ring_state_t;
 
+/**
+ * @brief   Method used to locate the last written block during mount.
+ */
+typedef enum {
+  /* read page 0 header of every good block in ring */
+  NAND_RING_MOUNT_BRUTE_FORCE = 0,
+  /* binary search for last written block and page */
+  NAND_RING_MOUNT_SEARCH
+} nand_ring_mount_t;
+
+/**
+ * @brief   How page data and its header get programmed.
+ */
+typedef enum {
+  /* program data then spare, ECC calculated by hardware */
+  NAND_RING_WRITE_SPLIT = 0,
+  /* program data and spare in single operation, ECC calculated in software */
+  NAND_RING_WRITE_WHOLE
+} nand_ring_write_t;
+
+/**
+ * @brief   Result of nandRingReadPage().
+ */
+typedef enum {
+  NAND_RING_READ_OK = 0,
+  /* bit error found and corrected */
+  NAND_RING_READ_CORRECTED,
+  /* page header erased or broken, page holds no data */
+  NAND_RING_READ_NO_DATA,
+  /* header is good but data has uncorrectable errors */
+  NAND_RING_READ_ECC_FAILED,
+  /* cursor passed the last page of session */
+  NAND_RING_READ_END,
+  /* writer erased or reused the block while cursor was reading session,
+     the rest of session is gone */
+  NAND_RING_READ_OVERWRITTEN
+} nand_ring_read_t;
+
 /**
  *
  */
 typedef struct {
-  uint32_t    start_blk;  // first block of storage
-  size_t      len;        // length of ring in blocks
-  NANDDriver  *nandp;
+  uint32_t            start_blk;  // first block of storage
+  size_t              len;        // length of ring in blocks
+  NANDDriver          *nandp;
+  nand_ring_mount_t   mount_mode; // last written block lookup method
+  nand_ring_write_t   write_mode; // page programming method
+  /**
+   * @brief   First block of checkpoint area. Must not overlap ring.
+   */
+  uint32_t            checkpoint_blk;
+  /**
+   * @brief   Length of checkpoint area in blocks. Set to 0 to disable
+   *          checkpoints, otherwise at least 2 blocks needed for ping-pong.
+   */
+  size_t              checkpoint_len;
+  /**
+   * @brief   Number of ring blocks written between checkpoints.
+   */
+  uint32_t            checkpoint_period;
+  /**
+   * @brief   Good blocks kept erased in front of the head, so block
+   *          rollover does not wait for erase. Set to 0 to erase on demand.
+   * @note    Must be less than 8, otherwise search mount degrades
+   *          to brute force.
+   */
+  uint32_t            erase_ahead;
+  /**
+   * @brief   RAM table of sessions filled by mount and kept up to date
+   *          while ring writes and overwrites blocks. Set to NULL to
+   *          disable.
+   * @note    The oldest sessions get dropped when table is full.
+   */
+  NandRingSession     *sessions;
+  size_t              sessions_len;
+  /**
+   * @brief   Reserve the last page of every block for NandBlockSummary.
+   * @note    Must stay the same for the whole life of ring data.
+   */
+  bool                block_summary;
+  /**
+   * @brief   Counts records of data page into summary, may be NULL.
+   *          See nandLogSummaryRecords() for framed log records.
+   */
+  nand_ring_summary_cb_t summary_cb;
 } NandRingConfig;
 
 /**
@@ -88,6 +280,27 @@ typedef struct {
   uint32_t    write_data_failed;
   uint32_t    write_spare_failed;
   uint32_t    erase_failed;
+  /* page headers read since mount */
+  uint32_t    spare_reads;
+  /* page headers read by mount procedure itself */
+  uint32_t    mount_spare_reads;
+  /* mount found ring head starting from checkpoint */
+  uint32_t    checkpoint_hit;
+  uint32_t    checkpoint_writes;
+  /* rollovers served from erase-ahead reserve and by on demand erase */
+  uint32_t    reserve_hits;
+  uint32_t    reserve_misses;
+  /* nandRingWritePage() duration */
+  uint32_t    write_latency_max_us;
+  uint32_t    write_latency_hist[NAND_RING_LATENCY_BUCKETS];
+  /* nandRingReadPage() results */
+  uint32_t    pages_read;
+  uint32_t    ecc_corrected;
+  uint32_t    ecc_uncorrectable;
+  /* block summary pages written */
+  uint32_t    summary_writes;
+  /* summary pages lost for lack of space after their data page stored */
+  uint32_t    summary_failed;
 } nand_ring_debug_t;
 
 /**
@@ -99,6 +312,41 @@ typedef struct {
   uint32_t              cur_page;
   uint32_t              utc_correction;
   uint16_t              cur_back_link;
+  /**
+   * @brief   Checkpoint area block and page to be written next.
+   */
+  uint32_t              cp_blk;
+  uint32_t              cp_page;
+  /**
+   * @brief   Ring blocks left to write until next checkpoint.
+   */
+  uint32_t              cp_countdown;
+  /**
+   * @brief   Good blocks in ring. Updated when ring marks block bad.
+   */
+  uint32_t              total_good;
+  /**
+   * @brief   Good blocks right after cur_blk which are already erased.
+   */
+  uint32_t              erased_ahead;
+  /**
+   * @brief   Last page holding valid header. Set by mount and every
+   *          page write, so iterator does not need to search for it.
+   *          head_blk is 0xFFFFFFFF when unknown.
+   */
+  uint32_t              head_blk;
+  uint32_t              head_page;
+  /**
+   * @brief   Session table position of the oldest entry, number of
+   *          entries and flag of entry created for session being written.
+   */
+  size_t                st_oldest;
+  size_t                st_count;
+  bool                  st_open;
+  /**
+   * @brief   Summary of data pages written to cur_blk so far.
+   */
+  NandBlockSummary      summary;
   nand_ring_state_t     state;
   nand_ring_debug_t     dbg;
   const NandRingConfig  *config;
@@ -118,12 +366,65 @@ typedef struct {
    * @brief last written block of the discovered session
    */
   uint32_t last_blk;
+  /**
+   * @brief last written page of last_blk
+   */
+  uint32_t last_page;
+  /**
+   * @brief page headers read by iterator since bind
+   */
+  uint32_t spare_reads;
   /**
    * @brief end if iteration flag
    */
   bool finished;
+  /**
+   * @brief iteration goes from the oldest session to the newest one
+   */
+  bool forward;
+  /**
+   * @brief session returned by the previous forward step
+   */
+  NandRingSession session;
 } NandRingIterator;
 
+/**
+ * @brief   Streams pages of single session in write order.
+ * @details When worker thread supplied, the next page is read while
+ *          caller processes the current one. Bus is taken for every
+ *          page, so cursor may run while ring keeps writing.
+ */
+typedef struct {
+  NandRing          *ring;
+  /**
+   * @brief   Next page to be read and the last page of session.
+   */
+  uint32_t          blk;
+  uint32_t          page;
+  uint32_t          last_blk;
+  uint32_t          last_page;
+  /**
+   * @brief   Id expected in the next page. Anything else means the
+   *          writer overwrote session while cursor was reading it.
+   */
+  uint64_t          id;
+  bool              end;
+  /**
+   * @brief   Two page data buffers supplied by caller.
+   */
+  uint8_t           *buf[2];
+  NandPageHeader    header[2];
+  nand_ring_read_t  status[2];
+  /**
+   * @brief   Buffer to be returned next and flag of buffer held by caller.
+   */
+  size_t            front;
+  bool              holding;
+  thread_t          *worker;
+  semaphore_t       empty;
+  semaphore_t       full;
+  volatile bool     stop;
+} NandRingCursor;
 
 #ifdef __cplusplus
 extern "C" {
@@ -135,10 +436,49 @@ extern "C" {
   uint32_t nandRingTotalGood(const NandRing *ring);
   void nandRingUmount(NandRing *ring);
   bool nandRingWritePage(NandRing *ring, const uint8_t *data);
+  size_t nandRingWritePages(NandRing *ring, const uint8_t *data, size_t npages);
+  size_t nandRingWritePagesv(NandRing *ring, const uint8_t * const *pages,
+                             const uint16_t *written, const uint16_t *first,
+                             size_t npages);
+  size_t nandRingEraseAhead(NandRing *ring);
+  uint32_t nandRingWriteLatency(const NandRing *ring, uint32_t percent);
   void nandRingStop(NandRing *ring);
   void nandRingErase(NandRing *ring);
   void nandRingSetUtcCorrection(NandRing *ring, uint32_t correction);
+  bool nandRingPageHeader(NandRing *ring, uint32_t blk, uint32_t page,
+                          NandPageHeader *header);
+  nand_ring_read_t nandRingReadPage(NandRing *ring, uint32_t blk, uint32_t page,
+                                    uint8_t *data, NandPageHeader *header);
+  void nandRingNextPage(const NandRing *ring, uint32_t *blk, uint32_t *page);
+  bool nandRingSeekId(NandRing *ring, uint64_t id, uint32_t *blk, uint32_t *page);
+  uint64_t nandRingPageTime(const NandRingSession *session,
+                            const NandPageHeader *header);
+  bool nandRingSeekTime(NandRing *ring, const NandRingSession *session,
+                        uint64_t utc_us, uint32_t *blk, uint32_t *page);
+  bool nandRingBlockSummary(NandRing *ring, uint32_t blk,
+                            NandBlockSummary *summary);
+  size_t nandRingSummaryRange(NandRing *ring, const NandRingSession *session,
+                              uint64_t from_utc_us, uint64_t to_utc_us,
+                              NandBlockSummary *total);
+  void nandRingCursorStart(NandRingCursor *cur, NandRing *ring,
+                           const NandRingSession *session, uint8_t *buffers,
+                           void *wa, size_t wa_size);
+  bool nandRingCursorStartTime(NandRingCursor *cur, NandRing *ring,
+                               const NandRingSession *session, uint64_t utc_us,
+                               uint8_t *buffers, void *wa, size_t wa_size);
+  nand_ring_read_t nandRingCursorNext(NandRingCursor *cur, const uint8_t **data,
+                                      NandPageHeader *header);
+  void nandRingCursorStop(NandRingCursor *cur);
+  size_t nandRingSessionCount(const NandRing *ring);
+  bool nandRingSessionGet(const NandRing *ring, size_t idx, NandRingSession *session);
+  bool nandRingSessionOldest(NandRing *ring, NandRingSession *session);
+  bool nandRingSessionNewest(NandRing *ring, NandRingSession *session);
+  bool nandRingSessionNewer(NandRing *ring, const NandRingSession *current,
+                            NandRingSession *session);
+  bool nandRingSessionOlder(NandRing *ring, const NandRingSession *current,
+                            NandRingSession *session);
   void NandRingIteratorBind(NandRingIterator *it, NandRing *ring);
+  void NandRingIteratorBindForward(NandRingIterator *it, NandRing *ring);
   void NandRingIteratorRelease(NandRingIterator *it);
   bool NandRingIteratorFinished(NandRingIterator *it);
   bool NandRingIteratorNext(NandRingIterator *it, NandRingSession *session);
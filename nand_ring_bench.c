@@ -0,0 +1,474 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "libnand.h"
+#include "soft_crc.h"
+#include "nand_ring.h"
+#include "nand_log.h"
+#include "nand_ring_bench.h"
+
+/*
+ ******************************************************************************
+ * DEFINES
+ ******************************************************************************
+ */
+
+#define NAND_BENCH_START_BLOCK    (4352)
+#define MOUNT_BENCH_ROUNDS        8
+#define NAND_BENCH_CP_BLOCK       (NAND_BENCH_START_BLOCK - 2)
+#define NAND_BENCH_CP_LEN         2
+#define NAND_BENCH_CP_PERIOD      16
+#define WRITE_BENCH_LEN           64
+#define WRITE_BENCH_BLOCKS        32
+#define ERASE_AHEAD_BENCH_DEPTH   4
+#define CURSOR_BENCH_BLOCKS       16
+#define LOG_BENCH_DEPTH           32
+#define LOG_BENCH_RECORD          64
+#define LOG_BENCH_RECORDS         4096
+#define LOG_BENCH_MAX_PRODUCERS   4
+
+/*
+ ******************************************************************************
+ * EXTERNS
+ ******************************************************************************
+ */
+
+/*
+ ******************************************************************************
+ * PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ ******************************************************************************
+ * GLOBAL VARIABLES
+ ******************************************************************************
+ */
+
+static const uint32_t mount_bench_len[] = {64, 256, 1024, 3072};
+
+#define MOUNT_BENCH_SIZES   (sizeof(mount_bench_len) / sizeof(mount_bench_len[0]))
+
+/*
+ * Mount time for different ring sizes. Inspect it using debugger.
+ */
+static time_measurement_t tmu_mount_brute[MOUNT_BENCH_SIZES];
+static time_measurement_t tmu_mount_search[MOUNT_BENCH_SIZES];
+static time_measurement_t tmu_mount_checkpoint[MOUNT_BENCH_SIZES];
+static uint32_t mount_reads_brute[MOUNT_BENCH_SIZES];
+static uint32_t mount_reads_search[MOUNT_BENCH_SIZES];
+static uint32_t mount_reads_checkpoint[MOUNT_BENCH_SIZES];
+
+/*
+ * Page write time and overall throughput in pages per second for
+ * split (index 0) and whole (index 1) page programming.
+ */
+static time_measurement_t tmu_write_page[2];
+static uint32_t write_bench_pps[2];
+
+/*
+ * Page write latency in microseconds without (index 0) and with
+ * (index 1) erase-ahead reserve.
+ */
+static uint32_t write_latency_p99[2];
+static uint32_t write_latency_max[2];
+
+/*
+ * Session offload speed in pages per second reading in caller thread
+ * (index 0) and with read-ahead worker (index 1). Every page gets
+ * checksummed emulating offload processing. Read-ahead can only win
+ * where NAND transfer overlaps that processing, so run it on target.
+ */
+static uint32_t cursor_bench_pps[2];
+
+static THD_WORKING_AREA(CursorBenchWA, NAND_RING_CURSOR_STACK);
+
+static const size_t log_bench_producers[] = {1, 2, 4};
+
+#define LOG_BENCH_ROUNDS    (sizeof(log_bench_producers) / sizeof(log_bench_producers[0]))
+
+/*
+ * Cost of concurrent appends to single log for 1, 2 and 4 producers:
+ * total time, average nandLogWrite() call time, number of times
+ * producer found lock taken and time spent waiting for free buffer.
+ * Only target runs give meaningful figures, inspect them using debugger.
+ */
+static uint32_t log_bench_total_us[LOG_BENCH_ROUNDS];
+static uint32_t log_bench_call_ns[LOG_BENCH_ROUNDS];
+static uint32_t log_bench_contended[LOG_BENCH_ROUNDS];
+static uint32_t log_bench_blocked_us[LOG_BENCH_ROUNDS];
+
+/**
+ * @brief   State of single producer thread in log benchmark.
+ */
+typedef struct {
+  NandLog   *log;
+  size_t    records;
+  uint64_t  cycles;
+} LogBenchProducer;
+
+static THD_WORKING_AREA(LogBenchWA[LOG_BENCH_MAX_PRODUCERS], 512);
+
+static THD_WORKING_AREA(LogBenchWorkerWA, NAND_LOG_WORKER_STACK);
+
+static LogBenchProducer log_bench_producer[LOG_BENCH_MAX_PRODUCERS];
+
+static NandLog nandlog;
+
+static NandLogConfig nandlogcfg = {
+  NULL,
+  LOG_BENCH_DEPTH,
+  NAND_LOG_OVERFLOW_BLOCK,
+  TIME_INFINITE,
+  0,
+  0,
+  LogBenchWorkerWA,
+  sizeof(LogBenchWorkerWA),
+  NORMALPRIO
+};
+
+static NandRingConfig nandringcfg = {
+  NAND_BENCH_START_BLOCK,
+  0,
+  NULL,
+  NAND_RING_MOUNT_BRUTE_FORCE,
+  NAND_RING_WRITE_SPLIT,
+  0,
+  0,
+  0,
+  0
+};
+
+static NandRing nandring;
+
+/*
+ ******************************************************************************
+ ******************************************************************************
+ * LOCAL FUNCTIONS
+ ******************************************************************************
+ ******************************************************************************
+ */
+
+/**
+ * @brief   Fill 3/4 of ring so the head lands somewhere in the middle.
+ */
+static void fill_ring(NandRing *ring, uint8_t *pagebuf) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t blocks = ring->config->len * 3 / 4;
+
+  nandRingErase(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t b=0; b<blocks; b++) {
+    for (size_t p=0; p<ppb; p++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+  }
+  nandRingUmount(ring);
+}
+
+/**
+ * @brief   Measure mount time using specified method.
+ * @param[out] reads  page headers read by the last mount
+ * @return  Block pointed by ring after mount.
+ */
+static uint32_t measure_mount(NandRing *ring, nand_ring_mount_t mode,
+                              time_measurement_t *tm, uint32_t *reads) {
+
+  uint32_t ret = 0;
+
+  nandringcfg.mount_mode = mode;
+  chTMObjectInit(tm);
+  for (size_t i=0; i<MOUNT_BENCH_ROUNDS; i++) {
+    chTMStartMeasurementX(tm);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    chTMStopMeasurementX(tm);
+    ret = ring->cur_blk;
+    *reads = ring->dbg.mount_spare_reads;
+    nandRingUmount(ring);
+  }
+
+  return ret;
+}
+
+/**
+ * @brief   Measure sustained page write speed using specified method.
+ * @return  Pages per second.
+ */
+static uint32_t measure_write(NandRing *ring, nand_ring_write_t mode,
+                              time_measurement_t *tm, const uint8_t *pagebuf) {
+
+  const size_t ppb = ring->config->nandp->config->pages_per_block;
+  const size_t pages = WRITE_BENCH_BLOCKS * ppb;
+
+  nandringcfg.write_mode = mode;
+  nandRingErase(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  chTMObjectInit(tm);
+  const systime_t start = chVTGetSystemTimeX();
+  for (size_t i=0; i<pages; i++) {
+    chTMStartMeasurementX(tm);
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    chTMStopMeasurementX(tm);
+  }
+  const uint32_t ms = ST2MS(chVTGetSystemTimeX() - start);
+  nandRingUmount(ring);
+
+  if (0 == ms)
+    return 0;
+  return (pages * 1000) / ms;
+}
+
+/**
+ * @brief   Append fixed size records measuring every call.
+ */
+static THD_FUNCTION(LogBenchThread, arg) {
+  LogBenchProducer *self = arg;
+  uint8_t record[LOG_BENCH_RECORD];
+
+  memset(record, 0x55, sizeof(record));
+  for (size_t i=0; i<self->records; i++) {
+    const rtcnt_t start = chSysGetRealtimeCounterX();
+    osalDbgCheck(sizeof(record) == nandLogWrite(self->log, record, sizeof(record)));
+    self->cycles += chSysGetRealtimeCounterX() - start;
+  }
+
+  chThdExit(MSG_OK);
+}
+
+/*
+ ******************************************************************************
+ * EXPORTED FUNCTIONS
+ ******************************************************************************
+ */
+
+/**
+ * @brief   Compare brute force mount against search mount on rings
+ *          of different size.
+ */
+void nandRingMountBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map) {
+
+  nandStart(nandp, config, bb_map);
+  nandringcfg.nandp = nandp;
+  uint8_t *ring_working_area = chHeapAlloc(NULL, nandRingWASize(nandp));
+  uint8_t *pagebuf = chHeapAlloc(NULL, config->page_data_size);
+  memset(pagebuf, 0x55, config->page_data_size);
+
+  for (size_t i=0; i<MOUNT_BENCH_SIZES; i++) {
+    nandRingObjectInit(&nandring);
+    nandringcfg.len = mount_bench_len[i];
+    nandringcfg.mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+    nandRingStart(&nandring, &nandringcfg, ring_working_area);
+
+    fill_ring(&nandring, pagebuf);
+    const uint32_t brute_blk = measure_mount(&nandring,
+                          NAND_RING_MOUNT_BRUTE_FORCE, &tmu_mount_brute[i],
+                          &mount_reads_brute[i]);
+    const uint32_t search_blk = measure_mount(&nandring,
+                          NAND_RING_MOUNT_SEARCH, &tmu_mount_search[i],
+                          &mount_reads_search[i]);
+    osalDbgCheck(brute_blk == search_blk);
+
+    /* the first mount stores checkpoint, all others use it */
+    nandRingStop(&nandring);
+    nandringcfg.checkpoint_blk = NAND_BENCH_CP_BLOCK;
+    nandringcfg.checkpoint_len = NAND_BENCH_CP_LEN;
+    nandringcfg.checkpoint_period = NAND_BENCH_CP_PERIOD;
+    nandRingStart(&nandring, &nandringcfg, ring_working_area);
+    nandEraseRange(nandp, NAND_BENCH_CP_BLOCK, NAND_BENCH_CP_LEN);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(&nandring));
+    nandRingUmount(&nandring);
+    const uint32_t cp_blk = measure_mount(&nandring,
+                          NAND_RING_MOUNT_SEARCH, &tmu_mount_checkpoint[i],
+                          &mount_reads_checkpoint[i]);
+    osalDbgCheck(brute_blk == cp_blk);
+
+    nandRingErase(&nandring);
+    nandRingStop(&nandring);
+    nandringcfg.checkpoint_blk = 0;
+    nandringcfg.checkpoint_len = 0;
+    nandringcfg.checkpoint_period = 0;
+  }
+
+  chHeapFree(pagebuf);
+  chHeapFree(ring_working_area);
+  nandStop(nandp);
+}
+
+/**
+ * @brief   Compare separate data and spare programming against single
+ *          whole page programming.
+ */
+void nandRingWriteBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map) {
+
+  nandStart(nandp, config, bb_map);
+  nandringcfg.nandp = nandp;
+  nandringcfg.len = WRITE_BENCH_LEN;
+  uint8_t *ring_working_area = chHeapAlloc(NULL, nandRingWASize(nandp));
+  uint8_t *pagebuf = chHeapAlloc(NULL, config->page_data_size);
+  memset(pagebuf, 0x55, config->page_data_size);
+
+  nandRingObjectInit(&nandring);
+  nandRingStart(&nandring, &nandringcfg, ring_working_area);
+  write_bench_pps[0] = measure_write(&nandring, NAND_RING_WRITE_SPLIT,
+                                     &tmu_write_page[0], pagebuf);
+  write_bench_pps[1] = measure_write(&nandring, NAND_RING_WRITE_WHOLE,
+                                     &tmu_write_page[1], pagebuf);
+  nandRingErase(&nandring);
+  nandRingStop(&nandring);
+  nandringcfg.write_mode = NAND_RING_WRITE_SPLIT;
+
+  chHeapFree(pagebuf);
+  chHeapFree(ring_working_area);
+  nandStop(nandp);
+}
+
+/**
+ * @brief   Compare page write latency with on demand erase against
+ *          erase-ahead reserve refilled between pages.
+ */
+void nandRingEraseAheadBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map) {
+
+  nandStart(nandp, config, bb_map);
+  nandringcfg.nandp = nandp;
+  nandringcfg.len = WRITE_BENCH_LEN;
+  uint8_t *ring_working_area = chHeapAlloc(NULL, nandRingWASize(nandp));
+  uint8_t *pagebuf = chHeapAlloc(NULL, config->page_data_size);
+  memset(pagebuf, 0x55, config->page_data_size);
+  const size_t pages = WRITE_BENCH_BLOCKS * config->pages_per_block;
+
+  nandRingObjectInit(&nandring);
+  for (size_t i=0; i<2; i++) {
+    nandringcfg.erase_ahead = (0 == i) ? 0 : ERASE_AHEAD_BENCH_DEPTH;
+    nandRingStart(&nandring, &nandringcfg, ring_working_area);
+    nandRingErase(&nandring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(&nandring));
+    for (size_t p=0; p<pages; p++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(&nandring, pagebuf));
+      nandRingEraseAhead(&nandring);
+    }
+    write_latency_p99[i] = nandRingWriteLatency(&nandring, 99);
+    write_latency_max[i] = nandRingWriteLatency(&nandring, 100);
+    nandRingUmount(&nandring);
+    nandRingErase(&nandring);
+    nandRingStop(&nandring);
+  }
+  nandringcfg.erase_ahead = 0;
+
+  chHeapFree(pagebuf);
+  chHeapFree(ring_working_area);
+  nandStop(nandp);
+}
+
+/**
+ * @brief   Measure contention cost of several threads appending to
+ *          the same log.
+ * @details The same amount of data is split evenly between producers.
+ */
+void nandLogProducerBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map) {
+
+  thread_t *producer[LOG_BENCH_MAX_PRODUCERS];
+
+  nandStart(nandp, config, bb_map);
+  nandringcfg.nandp = nandp;
+  nandringcfg.len = WRITE_BENCH_LEN;
+  uint8_t *ring_working_area = chHeapAlloc(NULL, nandRingWASize(nandp));
+  nandlogcfg.arena = chHeapAlloc(NULL, nandLogArenaSize(nandp, nandlogcfg.depth));
+
+  nandRingObjectInit(&nandring);
+  nandLogObjectInit(&nandlog);
+  for (size_t r=0; r<LOG_BENCH_ROUNDS; r++) {
+    const size_t n = log_bench_producers[r];
+    osalDbgCheck(n <= LOG_BENCH_MAX_PRODUCERS);
+
+    nandRingStart(&nandring, &nandringcfg, ring_working_area);
+    nandRingErase(&nandring);
+    nandRingStop(&nandring);
+    nandLogStart(&nandlog, &nandlogcfg, &nandring, &nandringcfg, ring_working_area);
+
+    const rtcnt_t start = chSysGetRealtimeCounterX();
+    for (size_t i=0; i<n; i++) {
+      log_bench_producer[i].log = &nandlog;
+      log_bench_producer[i].records = LOG_BENCH_RECORDS / n;
+      log_bench_producer[i].cycles = 0;
+      producer[i] = chThdCreateStatic(LogBenchWA[i], sizeof(LogBenchWA[i]),
+                      NORMALPRIO, LogBenchThread, &log_bench_producer[i]);
+    }
+    uint64_t cycles = 0;
+    for (size_t i=0; i<n; i++) {
+      chThdWait(producer[i]);
+      cycles += log_bench_producer[i].cycles;
+    }
+    log_bench_total_us[r] = RTC2US(halGetCounterFrequency(), chSysGetRealtimeCounterX() - start);
+    log_bench_call_ns[r] = (cycles * 1000) / (halGetCounterFrequency() / 1000000) / LOG_BENCH_RECORDS;
+    log_bench_contended[r] = nandlog.dbg.lock_contended;
+    log_bench_blocked_us[r] = nandlog.dbg.blocked_us;
+    nandLogStop(&nandlog);
+  }
+
+  nandRingStart(&nandring, &nandringcfg, ring_working_area);
+  nandRingErase(&nandring);
+  nandRingStop(&nandring);
+
+  chHeapFree(nandlogcfg.arena);
+  chHeapFree(ring_working_area);
+  nandStop(nandp);
+}
+
+/**
+ * @brief   Compare session streaming with and without read-ahead.
+ */
+void nandRingCursorBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map) {
+
+  NandRingIterator it;
+  NandRingSession session;
+  NandRingCursor cur;
+  const uint8_t *data;
+  uint32_t crc = 0;
+
+  nandStart(nandp, config, bb_map);
+  nandringcfg.nandp = nandp;
+  nandringcfg.len = WRITE_BENCH_LEN;
+  uint8_t *ring_working_area = chHeapAlloc(NULL, nandRingWASize(nandp));
+  uint8_t *buffers = chHeapAlloc(NULL, 2 * config->page_data_size);
+  memset(buffers, 0x55, config->page_data_size);
+  const size_t pages = CURSOR_BENCH_BLOCKS * config->pages_per_block;
+
+  nandRingObjectInit(&nandring);
+  nandRingStart(&nandring, &nandringcfg, ring_working_area);
+  nandRingErase(&nandring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(&nandring));
+  for (size_t p=0; p<pages; p++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(&nandring, buffers));
+  }
+
+  NandRingIteratorBind(&it, &nandring);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  for (size_t i=0; i<2; i++) {
+    nandRingCursorStart(&cur, &nandring, &session, buffers,
+                        (0 == i) ? NULL : CursorBenchWA, sizeof(CursorBenchWA));
+    size_t n = 0;
+    const rtcnt_t start = chSysGetRealtimeCounterX();
+    while (NAND_RING_READ_END != nandRingCursorNext(&cur, &data, NULL)) {
+      crc = softcrc32(data, config->page_data_size, crc);
+      n++;
+    }
+    const uint32_t us = RTC2US(halGetCounterFrequency(), chSysGetRealtimeCounterX() - start);
+    nandRingCursorStop(&cur);
+    osalDbgCheck(pages == n);
+    cursor_bench_pps[i] = (0 == us) ? 0 : (uint64_t)n * 1000000 / us;
+  }
+  NandRingIteratorRelease(&it);
+
+  nandRingUmount(&nandring);
+  nandRingErase(&nandring);
+  nandRingStop(&nandring);
+
+  chHeapFree(buffers);
+  chHeapFree(ring_working_area);
+  nandStop(nandp);
+}
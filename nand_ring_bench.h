@@ -0,0 +1,16 @@
+#ifndef NAND_RING_BENCH_H_
+#define NAND_RING_BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void nandRingMountBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map);
+  void nandRingWriteBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map);
+  void nandRingEraseAheadBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map);
+  void nandRingCursorBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map);
+  void nandLogProducerBench(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NAND_RING_BENCH_H_ */
@@ -5,6 +5,7 @@
 #include "hal.h"
 
 #include "libnand.h"
+#include "soft_crc.h"
 #include "nand_ring.h"
 #include "nand_ring_test.h"
 
@@ -17,6 +18,8 @@
 #define NAND_TEST_START_BLOCK     (2100)
 #define NAND_TEST_LEN             100
 #define NAND_TEST_LAST_BLOCK      (NAND_TEST_START_BLOCK + NAND_TEST_LEN - 1)
+#define NAND_TEST_CP_BLOCK        (NAND_TEST_START_BLOCK - 4)
+#define NAND_TEST_CP_LEN          3
 
 /*
  ******************************************************************************
@@ -39,13 +42,30 @@
 static NandRingConfig nandringcfg = {
   NAND_TEST_START_BLOCK,
   NAND_TEST_LEN,
-  NULL
+  NULL,
+  NAND_RING_MOUNT_BRUTE_FORCE,
+  NAND_RING_WRITE_SPLIT,
+  0,
+  0,
+  0,
+  0
 };
 
 static NandRing nandring;
 
 static uint16_t badblocks_table[64];
 
+static THD_WORKING_AREA(CursorWA, NAND_RING_CURSOR_STACK);
+
+static THD_WORKING_AREA(WriterWA, 1024);
+
+typedef struct {
+  NandRing        *ring;
+  uint8_t         *buf;
+  size_t          total;
+  volatile size_t written;
+} TestWriter;
+
 /*
  ******************************************************************************
  ******************************************************************************
@@ -132,6 +152,60 @@ void mount_trashed(NandRing *ring) {
   nandRingUmount(ring);
 }
 
+/**
+ * @brief   Program pages into the first ring block sealed with given
+ *          CRC seed, the way ring firmware of some format version would.
+ */
+static void write_raw_pages(NandRing *ring, size_t pages, uint32_t seed) {
+
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const uint32_t start = ring->config->start_blk;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandPageHeader header;
+  uint32_t ecc;
+
+  nandRingErase(ring);
+  memset(pagebuf, 0x5A, pds);
+  for (size_t p=0; p<pages; p++) {
+    memset(&header, 0xFF, sizeof(header));
+    header.id = 1 + p;
+    header.time_boot_us = 1000 * p;
+    header.utc_correction = 0;
+    header.back_link = start + ring->config->len - 1;
+    header.written = pds;
+    header.first_record = NAND_RING_NO_RECORD;
+    nandWritePageData(nandp, start, p, pagebuf, pds, &ecc);
+    header.page_ecc = ecc;
+    header.spare_crc = softcrc32((const uint8_t *)&header,
+                                 sizeof(header) - sizeof(header.spare_crc), seed);
+    nandWritePageSpare(nandp, start, p, &header, sizeof(header));
+  }
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Pages of other on-flash format version must look erased for
+ *          mount, pages of current version must be picked up.
+ */
+void mount_other_format(NandRing *ring) {
+
+  const size_t pages = 5;
+  osalDbgCheck(is_sequence_good(ring));
+
+  write_raw_pages(ring, pages, 0xFFFFFFFF ^ NAND_RING_FORMAT_VERSION);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(1 + pages == ring->cur_id);
+  nandRingUmount(ring);
+
+  write_raw_pages(ring, pages, 0xFFFFFFFF ^ (NAND_RING_FORMAT_VERSION - 1));
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(ring->config->start_blk == ring->cur_blk);
+  osalDbgCheck((0 == ring->cur_page) && (1 == ring->cur_id));
+  nandRingUmount(ring);
+  nandRingErase(ring);
+}
+
 /**
  * @brief write_page_test
  * @param ring
@@ -378,6 +452,47 @@ void mount_erased_with_bad(NandRing *ring) {
   chHeapFree(pagebuf);
 }
 
+/**
+ * @brief   Long run of bad blocks crossing several words of bad block map.
+ */
+void mount_bad_run(NandRing *ring) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  const uint32_t blk = ring->config->start_blk;
+  const uint32_t len = ring->config->len;
+  const uint32_t run_start = 20;
+  const uint32_t run_len = 41;
+
+  osalDbgCheck(is_sequence_good(ring));
+  __nandEraseRangeForce(nandp, blk, len);
+  for (size_t b=run_start; b<run_start+run_len; b++) {
+    nandMarkBad(nandp, blk + b);
+  }
+
+  nandRingMount(ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+  osalDbgCheck(len - run_len == nandRingTotalGood(ring));
+  osalDbgCheck(ring->cur_blk == blk);
+  for (size_t b=0; b<run_start; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+  }
+  osalDbgCheck(ring->cur_blk == blk + run_start + run_len);
+  osalDbgCheck(ring->cur_page == 0);
+  nandRingUmount(ring);
+
+  nandRingMount(ring);
+  osalDbgCheck(ring->cur_blk == blk + run_start + run_len);
+  nandRingUmount(ring);
+
+  __nandEraseRangeForce(nandp, blk, len);
+  chHeapFree(pagebuf);
+}
+
 /**
  *
  */
@@ -433,7 +548,10 @@ void error_handling(NandRing *ring) {
       id++;
     }
   }
+  /* cached counter must follow blocks marked bad during writing */
+  const uint32_t total_good = nandRingTotalGood(ring);
   nandRingUmount(ring);
+  osalDbgCheck(total_good == nandRingTotalGood(ring));
   __nandSetErrorChance(0);
   osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
 
@@ -461,225 +579,871 @@ void error_handling(NandRing *ring) {
 }
 
 /**
- * @brief iterator_empty_test
- * @param ring
+ * @brief   Compare last written block found by search against brute force.
+ * @details Writes random sized sessions over several laps of ring
+ *          with some bad blocks inside.
  */
-void iterator_empty(NandRing *ring) {
+void mount_search_vs_brute(NandRing *ring) {
 
-  const size_t start = ring->config->start_blk;
-  const size_t len   = ring->config->len;
-  NANDDriver *nandp  = ring->config->nandp;
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  NANDDriver *nandp = cfg->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  const uint32_t blk = cfg->start_blk;
+  const uint32_t len = cfg->len;
   NandRingIterator it;
-  NandRingSession session;
+  uint32_t brute_blk;
+
+  uint32_t log2len = 0;
+  while ((1U << log2len) < len)
+    log2len++;
 
-  nandEraseRange(nandp, start, len);
   osalDbgCheck(is_sequence_good(ring));
-  nandRingMount(ring);
+  nandEraseRange(nandp, blk, len);
+  nandMarkBad(nandp, blk + 5);
+  nandMarkBad(nandp, blk + len / 2);
+  nandMarkBad(nandp, blk + len / 2 + 1);
+  nandMarkBad(nandp, blk + len - 1);
+
+  for (size_t i=0; i<200; i++) {
+    cfg->mount_mode = (i & 1) ? NAND_RING_MOUNT_SEARCH : NAND_RING_MOUNT_BRUTE_FORCE;
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    const size_t pages = rand() % (3 * ppb);
+    for (size_t p=0; p<pages; p++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
 
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+    /* forget head cached by writes, so bind has to search for it */
+    const uint32_t head_blk = ring->head_blk;
+    const uint32_t head_page = ring->head_page;
+
+    cfg->mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+    ring->head_blk = 0xFFFFFFFF;
+    NandRingIteratorBind(&it, ring);
+    brute_blk = it.last_blk;
+    /* every good block */
+    osalDbgCheck(it.spare_reads >= len - 4);
+    NandRingIteratorRelease(&it);
+
+    cfg->mount_mode = NAND_RING_MOUNT_SEARCH;
+    ring->head_blk = 0xFFFFFFFF;
+    NandRingIteratorBind(&it, ring);
+    osalDbgCheck(brute_blk == it.last_blk);
+    /* bisection plus probing over bad blocks and closed sessions */
+    osalDbgCheck(it.spare_reads <= 2 * log2len + 4);
+    NandRingIteratorRelease(&it);
+
+    ring->head_blk = head_blk;
+    ring->head_page = head_page;
+    if (pages > 0)
+      osalDbgCheck(brute_blk == head_blk);
+
+    nandRingUmount(ring);
+  }
 
-  nandRingUmount(ring);
+  cfg->mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+  __nandEraseRangeForce(nandp, blk, len);
+  chHeapFree(pagebuf);
 }
 
 /**
- *
+ * @brief   Check last page search and its fallback on broken header.
  */
-void iterator_single_session(NandRing *ring) {
-  const size_t start = ring->config->start_blk;
-  const size_t len   = ring->config->len;
-  NANDDriver *nandp  = ring->config->nandp;
-  const size_t ppb = nandp->config->pages_per_block;
+void mount_search_last_page(NandRing *ring) {
+
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  NANDDriver *nandp = cfg->nandp;
   const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
   uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  const uint32_t blk = cfg->start_blk;
+  const size_t N = ppb / 2 + 3;
   NandRingIterator it;
   NandRingSession session;
-  bool status;
+  NandPageHeader garbage;
 
-  osalDbgCheck(is_sequence_good(ring));
-  nandEraseRange(nandp, start, len);
-  nandRingMount(ring);
+  uint32_t log2len = 0;
+  while ((1U << log2len) < cfg->len)
+    log2len++;
+  uint32_t log2ppb = 0;
+  while ((1U << log2ppb) < ppb)
+    log2ppb++;
 
-  /* single page written */
-  status = nandRingWritePage(ring, pagebuf);
-  osalDbgCheck(OSAL_SUCCESS == status);
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_page == 0);
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+  osalDbgCheck(is_sequence_good(ring));
+  nandEraseRange(nandp, blk, cfg->len);
+  cfg->mount_mode = NAND_RING_MOUNT_SEARCH;
 
-  /* single block written */
-  for (size_t i=1; i<ppb; i++) {
-    status = nandRingWritePage(ring, pagebuf);
-    osalDbgCheck(OSAL_SUCCESS == status);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<N; p++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
   }
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_page == ppb - 1);
-  NandRingIteratorRelease(&it);
-
-  /* block + page written */
-  status = nandRingWritePage(ring, pagebuf);
-  osalDbgCheck(OSAL_SUCCESS == status);
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK + 1);
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + 1);
-  osalDbgCheck(session.last_page == 0);
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+  nandRingUmount(ring);
 
-  /* ring written */
-  for (size_t i=1; i<ppb; i++) {
-    status = nandRingWritePage(ring, pagebuf);
-    osalDbgCheck(OSAL_SUCCESS == status);
-  }
-  for (size_t b=2; b<NAND_TEST_LEN; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
-    }
+  /* last written page will be zeroed by mount */
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(ring->cur_blk == blk + 1);
+  osalDbgCheck(ring->cur_id  == N + 1);
+  /* block bisection plus page bisection, far less than brute force
+     len + ppb reads */
+  osalDbgCheck(ring->dbg.mount_spare_reads <= 2 * log2len + log2ppb + 4);
+  for (size_t p=0; p<N; p++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
   }
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(it.last_blk == NAND_TEST_LAST_BLOCK);
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + 1);
-  osalDbgCheck(session.last_blk == NAND_TEST_LAST_BLOCK);
-  osalDbgCheck(session.last_page == ppb - 1);
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
 
-  /* Uroboros tests */
-  status = nandRingWritePage(ring, pagebuf);
-  osalDbgCheck(OSAL_SUCCESS == status);
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + 1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_page == 0);
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+  /* break header in the middle of block */
+  memset(&garbage, 0xF0, sizeof(garbage));
+  nandWritePageSpare(nandp, blk + 1, N / 2, (uint8_t *)&garbage, sizeof(garbage));
 
-  for (size_t i=1; i<ppb; i++) {
-    status = nandRingWritePage(ring, pagebuf);
-    osalDbgCheck(OSAL_SUCCESS == status);
-  }
-  for (size_t b=1; b<10; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
-    }
-  }
   NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK + 9);
+  osalDbgCheck(it.last_blk == blk + 1);
   osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + 9 + 2);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + 9);
-  osalDbgCheck(session.last_page == ppb - 1);
+  osalDbgCheck(session.first_blk == blk + 1);
+  osalDbgCheck(session.last_blk == blk + 1);
+  osalDbgCheck(session.last_page == N - 1);
   NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
 
   nandRingUmount(ring);
+  cfg->mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+  nandEraseRange(nandp, blk, cfg->len);
   chHeapFree(pagebuf);
 }
 
 /**
- * @brief iterator_multisession
- * @param ring
+ * @brief   Mount using checkpoints must find the same head as brute force.
+ * @details Writes random sized sessions with error injection, so bad
+ *          blocks appear both in ring and in checkpoint area.
  */
-void iterator_multisession(NandRing *ring, size_t tail_len) {
-  const size_t start = ring->config->start_blk;
-  const size_t len   = ring->config->len;
-  NANDDriver *nandp  = ring->config->nandp;
-  const size_t ppb = nandp->config->pages_per_block;
+void mount_checkpoint(NandRing *ring) {
+
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  NANDDriver *nandp = cfg->nandp;
+  uint8_t *wa = ring->wa;
   const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
   uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint32_t expected = 0xFFFFFFFF;
   NandRingIterator it;
-  NandRingSession session;
-  const size_t N1 = 12;
-  const size_t N2 = 24;
+
+  uint32_t log2ppb = 0;
+  while ((1U << log2ppb) < ppb)
+    log2ppb++;
 
   osalDbgCheck(is_sequence_good(ring));
-  nandEraseRange(nandp, start, len);
+  nandRingStop(ring);
+  cfg->checkpoint_blk = NAND_TEST_CP_BLOCK;
+  cfg->checkpoint_len = NAND_TEST_CP_LEN;
+  cfg->checkpoint_period = 3;
+  cfg->mount_mode = NAND_RING_MOUNT_SEARCH;
+  nandRingStart(ring, cfg, wa);
+  nandRingErase(ring);
+
+  for (size_t i=0; i<150; i++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    if (0xFFFFFFFF != expected) {
+      osalDbgCheck(expected == ring->cur_back_link);
+      if (0xFFFFFFFF != ring->cp_blk) {
+        osalDbgCheck(1 == ring->dbg.checkpoint_hit);
+        /* page 0 of every area block and bisection inside the newest
+           one, blocks written since checkpoint, page search in head
+           block. Probing over wasted blocks adds a few more. */
+        osalDbgCheck(ring->dbg.mount_spare_reads <= cfg->checkpoint_len
+                     + 2 * log2ppb + cfg->checkpoint_period + 12);
+      }
+    }
 
-  /* 2 sessions not full ring */
-  nandRingMount(ring);
-  for (size_t b=0; b<N1; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
+    __nandSetErrorChance(2048);
+    const size_t pages = rand() % (3 * ppb);
+    for (size_t p=0; p<pages; p++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
     }
-  }
-  nandRingUmount(ring);
-  nandRingMount(ring);
-  for (size_t b=0; b<N2; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
+    __nandSetErrorChance(0);
+
+    if (1 != ring->cur_id) {
+      NandRingIteratorBind(&it, ring);
+      expected = it.last_blk;
+      NandRingIteratorRelease(&it);
     }
+    nandRingUmount(ring);
   }
 
-  NandRingIteratorBind(&it, ring);
-  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  __nandEraseRangeForce(nandp, cfg->start_blk, cfg->len);
+  __nandEraseRangeForce(nandp, NAND_TEST_CP_BLOCK, NAND_TEST_CP_LEN);
+  nandRingStop(ring);
+  cfg->checkpoint_blk = 0;
+  cfg->checkpoint_len = 0;
+  cfg->checkpoint_period = 0;
+  cfg->mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+  nandRingStart(ring, cfg, wa);
+  chHeapFree(pagebuf);
+}
 
-  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
-  osalDbgCheck(session.last_page == 63);
+/**
+ * @brief   Pages programmed by single operation must be indistinguishable
+ *          from pages programmed by separate data and spare writes.
+ */
+void write_whole_test(NandRing *ring) {
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
-  osalDbgCheck(session.last_page == 63);
+  NANDDriver *nandp = ring->config->nandp;
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  const uint32_t blk = ring->config->start_blk;
+  const size_t pages = 3 * ppb + 5;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *readbuf = chHeapAlloc(NULL, pds);
+  NandPageHeader header;
+  uint32_t ecc;
 
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+
+  /* first half of pages written split, second half whole */
+  for (size_t i=0; i<2; i++) {
+    cfg->write_mode = (0 == i) ? NAND_RING_WRITE_SPLIT : NAND_RING_WRITE_WHOLE;
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    for (size_t p=0; p<pages; p++) {
+      memset(pagebuf, p & 0xFF, pds);
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+    nandRingUmount(ring);
+  }
+  cfg->write_mode = NAND_RING_WRITE_SPLIT;
+
+  /* previous session was closed at the end of its last block, and its
+     last page was discarded by the next mount */
+  const size_t session_pages = (pages / ppb + 1) * ppb;
+  uint64_t id = 0;
+  for (size_t i=0; i<2; i++) {
+    const size_t valid = (0 == i) ? pages - 1 : pages;
+    for (size_t p=0; p<valid; p++) {
+      const size_t n = i * session_pages + p;
+      nandReadPageData(nandp, blk + n / ppb, n % ppb, readbuf, pds, &ecc);
+      nandReadPageSpare(nandp, blk + n / ppb, n % ppb,
+                        (uint8_t *)&header, sizeof(header));
+      memset(pagebuf, p & 0xFF, pds);
+      osalDbgCheck(0 == memcmp(pagebuf, readbuf, pds));
+      osalDbgCheck(ecc == header.page_ecc);
+      osalDbgCheck(0xFFFF == header.bad_mark);
+      osalDbgCheck(pds == header.written);
+      osalDbgCheck(id < header.id);
+      id = header.id;
+    }
+  }
 
-  /* write third session to the end of ring */
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(ring->cur_blk == blk + 2 * session_pages / ppb);
   nandRingUmount(ring);
-  nandRingMount(ring);
+
+  nandRingErase(ring);
+  chHeapFree(readbuf);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Clear single bit of already programmed page data emulating
+ *          bit error.
+ */
+static void clear_bit(NANDDriver *nandp, uint32_t blk, uint32_t page,
+                      uint8_t *buf, size_t byte, uint8_t bit) {
+
+  const size_t pds = nandp->config->page_data_size;
+  uint32_t ecc;
+
+  memset(buf, 0xFF, pds);
+  buf[byte] &= ~(1U << bit);
+  nandWritePageData(nandp, blk, page, buf, pds, &ecc);
+}
+
+/**
+ * @brief   Deterministic page content with both set and cleared bits.
+ */
+static void fill_page(uint8_t *buf, size_t len, size_t seed) {
+
+  for (size_t i=0; i<len; i++) {
+    buf[i] = (seed * 31 + i * 7) | 0x11;
+  }
+}
+
+/**
+ * @brief   Read pages back checking ECC. Single bit errors must be
+ *          corrected, double ones detected.
+ */
+void read_page_test(NandRing *ring) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pages = ppb + 3;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *readbuf = chHeapAlloc(NULL, pds);
+  NandPageHeader header;
+
+  osalDbgCheck(is_sequence_good(ring));
+
+  for (size_t i=0; i<2; i++) {
+    cfg->write_mode = (0 == i) ? NAND_RING_WRITE_SPLIT : NAND_RING_WRITE_WHOLE;
+    nandRingErase(ring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    const uint32_t blk = ring->cur_blk;
+    for (size_t p=0; p<pages; p++) {
+      fill_page(pagebuf, pds, p);
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+    nandRingUmount(ring);
+
+    const uint32_t corrected = ring->dbg.ecc_corrected;
+    const uint32_t failed = ring->dbg.ecc_uncorrectable;
+    uint64_t id = 0;
+    for (size_t p=0; p<pages; p++) {
+      const uint32_t b = blk + p / ppb;
+      osalDbgCheck(NAND_RING_READ_OK == nandRingReadPage(ring, b, p % ppb, readbuf, &header));
+      fill_page(pagebuf, pds, p);
+      osalDbgCheck(0 == memcmp(pagebuf, readbuf, pds));
+      osalDbgCheck(id < header.id);
+      id = header.id;
+    }
+
+    /* single bit errors at both ends of page */
+    clear_bit(nandp, blk, 1, readbuf, 3, 4);
+    clear_bit(nandp, blk, 2, readbuf, pds - 1, 0);
+    for (size_t p=1; p<3; p++) {
+      osalDbgCheck(NAND_RING_READ_CORRECTED == nandRingReadPage(ring, blk, p, readbuf, &header));
+      fill_page(pagebuf, pds, p);
+      osalDbgCheck(0 == memcmp(pagebuf, readbuf, pds));
+    }
+
+    /* two bit errors */
+    clear_bit(nandp, blk, 3, readbuf, 10, 0);
+    clear_bit(nandp, blk, 3, readbuf, 20, 4);
+    osalDbgCheck(NAND_RING_READ_ECC_FAILED == nandRingReadPage(ring, blk, 3, readbuf, &header));
+
+    /* never written page */
+    osalDbgCheck(NAND_RING_READ_NO_DATA == nandRingReadPage(ring, blk + pages / ppb,
+                                                pages % ppb, readbuf, &header));
+
+    osalDbgCheck(corrected + 2 == ring->dbg.ecc_corrected);
+    osalDbgCheck(failed + 1 == ring->dbg.ecc_uncorrectable);
+  }
+  cfg->write_mode = NAND_RING_WRITE_SPLIT;
+
+  nandRingErase(ring);
+  chHeapFree(readbuf);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Seek must find every page still present in wrapped ring with
+ *          bad blocks using logarithmic number of header reads.
+ */
+void seek_id_test(NandRing *ring) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  const uint32_t start = ring->config->start_blk;
+  const uint32_t len = ring->config->len;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandPageHeader header;
+  uint32_t blk, page;
+
+  osalDbgCheck(is_sequence_good(ring));
+  __nandEraseRangeForce(nandp, start, len);
+  nandMarkBad(nandp, start + 7);
+  nandMarkBad(nandp, start + 8);
+  nandMarkBad(nandp, start + len / 2);
+
+  /* binary search over blocks plus single page read, probing may add
+     a few more */
+  uint32_t log2len = 0;
+  while ((1U << log2len) < len)
+    log2len++;
+  const uint32_t max_reads = (log2len + 2) * 2 + 8;
+
+  /* ring which has not wrapped yet starts with run of erased blocks,
+     they are bisected like the written ones */
+  memset(pagebuf, 0x55, pds);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  const uint64_t first = ring->cur_id;
+  for (size_t i=0; i<(len / 3) * ppb + 5; i++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+  }
+  for (size_t i=0; i<200; i++) {
+    const uint64_t id = first + rand() % (ring->cur_id - first);
+    const uint32_t reads = ring->dbg.spare_reads;
+    osalDbgCheck(OSAL_SUCCESS == nandRingSeekId(ring, id, &blk, &page));
+    osalDbgCheck(ring->dbg.spare_reads - reads <= 2 * log2len + 4);
+    osalDbgCheck(nandRingPageHeader(ring, blk, page, &header));
+    osalDbgCheck(id == header.id);
+  }
+  nandRingUmount(ring);
+
+  /* sessions of odd length wrap the ring one and a half times */
+  size_t written = 0;
+  while (written < (len * ppb * 3) / 2) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    const size_t n = 5 * ppb + rand() % (10 * ppb);
+    for (size_t i=0; i<n; i++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+    written += n;
+    nandRingUmount(ring);
+  }
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t i=0; i<ppb/2; i++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+  }
+
+  /* the oldest surviving page is page 0 of the first valid block after
+     the head */
+  blk = ring->cur_blk;
+  do {
+    page = ppb - 1;
+    nandRingNextPage(ring, &blk, &page);
+  } while (! nandRingPageHeader(ring, blk, page, &header));
+  const uint64_t oldest = header.id;
+  const uint64_t newest = ring->cur_id - 1;
+
+  /* the newest pages, then random ones */
+  size_t missed = 0;
+  for (size_t i=0; i<500; i++) {
+    const uint64_t id = (i < ppb) ? newest - i : oldest + rand() % (newest - oldest);
+    const uint32_t reads = ring->dbg.spare_reads;
+    if (OSAL_SUCCESS == nandRingSeekId(ring, id, &blk, &page)) {
+      osalDbgCheck(ring->dbg.spare_reads - reads <= max_reads);
+      osalDbgCheck(nandRingPageHeader(ring, blk, page, &header));
+      osalDbgCheck(id == header.id);
+    }
+    else {
+      /* last page of closed session gets discarded by the next mount */
+      missed++;
+    }
+  }
+  osalDbgCheck(missed < 500 / 50);
+
+  osalDbgCheck(OSAL_FAILED == nandRingSeekId(ring, ring->cur_id, &blk, &page));
+  osalDbgCheck(OSAL_FAILED == nandRingSeekId(ring, 0, &blk, &page));
+  osalDbgCheck(OSAL_FAILED == nandRingSeekId(ring, oldest - 1, &blk, &page));
+  osalDbgCheck(OSAL_SUCCESS == nandRingSeekId(ring, oldest, &blk, &page));
+
+  /* full ring stays readable */
+  ring->state = NAND_RING_NO_SPACE;
+  osalDbgCheck(OSAL_SUCCESS == nandRingSeekId(ring, newest, &blk, &page));
+  ring->state = NAND_RING_MOUNTED;
+
+  nandRingUmount(ring);
+  __nandEraseRangeForce(nandp, start, len);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Runs of pages written by single call must be laid out exactly
+ *          as pages written one by one, including runs crossing block
+ *          boundaries and bad block rescue.
+ */
+void write_pages_test(NandRing *ring) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  const uint32_t len = ring->config->len;
+  const size_t batch_max = 11;
+  uint8_t *batch = chHeapAlloc(NULL, pds * batch_max);
+  const uint8_t *pagev[batch_max];
+  uint16_t written[batch_max];
+  uint16_t first[batch_max];
+  uint8_t *readbuf = chHeapAlloc(NULL, pds);
+  const size_t total_max = (len / 2) * ppb + batch_max;
+  uint16_t *expected = chHeapAlloc(NULL, total_max * sizeof(uint16_t));
+  uint16_t *expected_first = chHeapAlloc(NULL, total_max * sizeof(uint16_t));
+  NandPageHeader header;
+  uint32_t ecc;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+
+  /* page content is its sequence number */
+  size_t total = 0;
+  __nandSetErrorChance(2048);
+  while (total < (len / 2) * ppb) {
+    const size_t n = 1 + rand() % batch_max;
+    for (size_t i=0; i<n; i++) {
+      memset(&batch[i * pds], (total + i) & 0xFF, pds);
+      pagev[n - 1 - i] = &batch[i * pds];
+    }
+    if (total & 1) {
+      osalDbgCheck(n == nandRingWritePages(ring, batch, n));
+      for (size_t i=0; i<n; i++) {
+        expected[total + i] = pds;
+        expected_first[total + i] = NAND_RING_NO_RECORD;
+      }
+    }
+    else {
+      /* reverse pointer order, so page order differs from memory order */
+      for (size_t i=0; i<n; i++) {
+        memset(&batch[i * pds], (total + n - 1 - i) & 0xFF, pds);
+        written[i] = pds - rand() % pds;
+        expected[total + i] = written[i];
+        first[i] = (0 == i % 3) ? NAND_RING_NO_RECORD : written[i] / 2;
+        expected_first[total + i] = first[i];
+      }
+      osalDbgCheck(n == nandRingWritePagesv(ring, pagev, written, first, n));
+    }
+    total += n;
+  }
+  __nandSetErrorChance(0);
+  const uint64_t last_id = ring->cur_id;
+  nandRingUmount(ring);
+
+  /* walk over good blocks and check every page */
+  uint32_t blk = ring->config->start_blk;
+  uint64_t id = 0;
+  uint64_t time = 0;
+  for (size_t p=0; p<total; p++) {
+    if ((p > 0) && (0 == p % ppb)) {
+      blk++;
+    }
+    while (nandIsBad(nandp, blk)) {
+      blk++;
+    }
+    nandReadPageData(nandp, blk, p % ppb, readbuf, pds, &ecc);
+    nandReadPageSpare(nandp, blk, p % ppb, (uint8_t *)&header, sizeof(header));
+    osalDbgCheck((p & 0xFF) == readbuf[0]);
+    osalDbgCheck((p & 0xFF) == readbuf[pds - 1]);
+    /* rescued pages must be moved before failed block gets bad mark */
+    osalDbgCheck(0xFFFF == header.bad_mark);
+    osalDbgCheck(ecc == header.page_ecc);
+    osalDbgCheck(expected[p] == header.written);
+    osalDbgCheck(expected_first[p] == header.first_record);
+    osalDbgCheck((0 == id) || (id + 1 == header.id));
+    id = header.id;
+    /* pages of batch are stamped one by one */
+    osalDbgCheck(header.time_boot_us > time);
+    time = header.time_boot_us;
+  }
+  osalDbgCheck(id + 1 == last_id);
+
+  /* batch stops at the first page which does not fit */
+  nandRingErase(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  ring->state = NAND_RING_NO_SPACE;
+  osalDbgCheck(0 == nandRingWritePages(ring, batch, batch_max));
+  ring->state = NAND_RING_MOUNTED;
+  nandRingUmount(ring);
+
+  __nandEraseRangeForce(nandp, ring->config->start_blk, len);
+  chHeapFree(expected_first);
+  chHeapFree(expected);
+  chHeapFree(readbuf);
+  chHeapFree(batch);
+}
+
+/**
+ * @brief   Check whether block looks erased by its first page header.
+ */
+static bool block_erased(NANDDriver *nandp, uint32_t blk) {
+  NandPageHeader header;
+
+  nandReadPageSpare(nandp, blk, 0, (uint8_t *)&header, sizeof(header));
+  for (size_t i=0; i<sizeof(header); i++) {
+    if (0xFF != ((uint8_t *)&header)[i])
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief   Block rollover must take blocks from erase-ahead reserve
+ *          filled between page writes.
+ */
+void erase_ahead_test(NandRing *ring) {
+
+  NANDDriver *nandp = ring->config->nandp;
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  const size_t pds = nandp->config->page_data_size;
+  const size_t ppb = nandp->config->pages_per_block;
+  const uint32_t blk = ring->config->start_blk;
+  const uint32_t len = ring->config->len;
+  const uint32_t depth = 4;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  memset(pagebuf, 0xA5, pds);
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+  cfg->erase_ahead = depth;
+
+  /* reserve fills one block per call */
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(depth - 1 == nandRingEraseAhead(ring));
+  while (nandRingEraseAhead(ring) > 0)
+    ;
+  osalDbgCheck(depth == ring->erased_ahead);
+  osalDbgCheck(0 == nandRingEraseAhead(ring));
+
+  /* make some full circles so every rollover uses reserve */
+  for (size_t p=0; p<(2 * len + 3) * ppb; p++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    nandRingEraseAhead(ring);
+  }
+  osalDbgCheck(0 == ring->dbg.reserve_misses);
+  osalDbgCheck(ring->dbg.reserve_hits >= 2 * len);
+  osalDbgCheck(depth == ring->erased_ahead);
+  uint32_t b = ring->cur_blk;
+  for (size_t i=0; i<depth; i++) {
+    b = (b == blk + len - 1) ? blk : b + 1;
+    osalDbgCheck(block_erased(nandp, b));
+  }
+  osalDbgCheck(nandRingWriteLatency(ring, 99) <= nandRingWriteLatency(ring, 100));
+  const uint32_t head = ring->cur_blk;
+  nandRingUmount(ring);
+
+  /* head must be found in spite of erased blocks after it */
+  cfg->mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  const uint32_t brute_head = ring->cur_blk;
+  nandRingUmount(ring);
+  osalDbgCheck(brute_head == head);
+  cfg->mount_mode = NAND_RING_MOUNT_SEARCH;
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(brute_head == ring->cur_blk);
+  nandRingUmount(ring);
+  cfg->mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+
+  /* on demand erase still works when reserve is empty */
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<2 * ppb; p++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+  }
+  osalDbgCheck(2 == ring->dbg.reserve_misses);
+  nandRingUmount(ring);
+
+  cfg->erase_ahead = 0;
+  nandRingErase(ring);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief iterator_empty_test
+ * @param ring
+ */
+void iterator_empty(NandRing *ring) {
+
+  const size_t start = ring->config->start_blk;
+  const size_t len   = ring->config->len;
+  NANDDriver *nandp  = ring->config->nandp;
+  NandRingIterator it;
+  NandRingSession session;
+
+  nandEraseRange(nandp, start, len);
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingMount(ring);
+
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  nandRingUmount(ring);
+}
+
+/**
+ *
+ */
+void iterator_single_session(NandRing *ring) {
+  const size_t start = ring->config->start_blk;
+  const size_t len   = ring->config->len;
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandRingIterator it;
+  NandRingSession session;
+  bool status;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandEraseRange(nandp, start, len);
+  nandRingMount(ring);
+
+  /* single page written */
+  status = nandRingWritePage(ring, pagebuf);
+  osalDbgCheck(OSAL_SUCCESS == status);
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_page == 0);
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  /* single block written */
+  for (size_t i=1; i<ppb; i++) {
+    status = nandRingWritePage(ring, pagebuf);
+    osalDbgCheck(OSAL_SUCCESS == status);
+  }
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_page == ppb - 1);
+  NandRingIteratorRelease(&it);
+
+  /* block + page written */
+  status = nandRingWritePage(ring, pagebuf);
+  osalDbgCheck(OSAL_SUCCESS == status);
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK + 1);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + 1);
+  osalDbgCheck(session.last_page == 0);
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  /* ring written */
+  for (size_t i=1; i<ppb; i++) {
+    status = nandRingWritePage(ring, pagebuf);
+    osalDbgCheck(OSAL_SUCCESS == status);
+  }
+  for (size_t b=2; b<NAND_TEST_LEN; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(it.last_blk == NAND_TEST_LAST_BLOCK);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + 1);
+  osalDbgCheck(session.last_blk == NAND_TEST_LAST_BLOCK);
+  osalDbgCheck(session.last_page == ppb - 1);
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  /* Uroboros tests */
+  status = nandRingWritePage(ring, pagebuf);
+  osalDbgCheck(OSAL_SUCCESS == status);
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + 1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_page == 0);
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  for (size_t i=1; i<ppb; i++) {
+    status = nandRingWritePage(ring, pagebuf);
+    osalDbgCheck(OSAL_SUCCESS == status);
+  }
+  for (size_t b=1; b<10; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK + 9);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + 9 + 2);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + 9);
+  osalDbgCheck(session.last_page == ppb - 1);
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  nandRingUmount(ring);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief iterator_multisession
+ * @param ring
+ */
+void iterator_multisession(NandRing *ring, size_t tail_len) {
+  const size_t start = ring->config->start_blk;
+  const size_t len   = ring->config->len;
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandRingIterator it;
+  NandRingSession session;
+  const size_t N1 = 12;
+  const size_t N2 = 24;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandEraseRange(nandp, start, len);
+
+  /* 2 sessions not full ring */
+  nandRingMount(ring);
+  for (size_t b=0; b<N1; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+  nandRingUmount(ring);
+  nandRingMount(ring);
+  for (size_t b=0; b<N2; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(NAND_RING_ITERATOR_BOUNDED == it.ring->state);
+
+  osalDbgCheck(it.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  /* write third session to the end of ring */
+  nandRingUmount(ring);
+  nandRingMount(ring);
   const size_t N3 = NAND_TEST_LEN - N1 - N2 - tail_len;
   for (size_t b=0; b<N3; b++) {
     for (size_t i=0; i<ppb; i++) {
@@ -711,174 +1475,982 @@ void iterator_multisession(NandRing *ring, size_t tail_len) {
   osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
   osalDbgCheck(session.last_page == 63);
 
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
-  NandRingIteratorRelease(&it);
-  osalDbgCheck(NULL == it.ring);
-  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(NULL == it.ring);
+  osalDbgCheck(NAND_RING_MOUNTED == ring->state);
+
+  nandRingUmount(ring);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief iterator_multisession_overlap
+ * @param ring
+ */
+void iterator_multisession_overlap(NandRing *ring) {
+  const size_t start = ring->config->start_blk;
+  const size_t len   = ring->config->len;
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandRingIterator it;
+  NandRingSession session;
+  const size_t N1 = 12;
+  const size_t N2 = 24;
+  size_t N3;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandEraseRange(nandp, start, len);
+
+  /* 2 sessions not full ring */
+  nandRingMount(ring);
+  for (size_t b=0; b<N1; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+  nandRingUmount(ring);
+  nandRingMount(ring);
+  for (size_t b=0; b<N2; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+
+  /* write third session to overlap first session */
+  nandRingUmount(ring);
+  nandRingMount(ring);
+  N3 = NAND_TEST_LEN - N1 - N2 + N1/2;
+  for (size_t b=0; b<N3; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+
+  NandRingIteratorBind(&it, ring);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1/2 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1/2 + 1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
+  osalDbgCheck(session.last_page == 63);
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  NandRingIteratorRelease(&it);
+
+
+  /* write third session over the whole first session */
+  N3 = N1/2;
+  for (size_t b=0; b<N3; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+
+  NandRingIteratorBind(&it, ring);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + 1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+
+  NandRingIteratorRelease(&it);
+
+
+  /* write third session over the half of second session */
+  N3 = N2/2;
+  for (size_t b=0; b<N3; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+
+  NandRingIteratorBind(&it, ring);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(! NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2/2 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2/2 + 1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
+  osalDbgCheck(session.last_page == 63);
+
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+
+  NandRingIteratorRelease(&it);
+
+
+  /* write third session over the whole second session */
+  N3 = N2/2;
+  for (size_t b=0; b<N3; b++) {
+    for (size_t i=0; i<ppb; i++) {
+      bool status = nandRingWritePage(ring, pagebuf);
+      osalDbgCheck(OSAL_SUCCESS == status);
+    }
+  }
+
+  NandRingIteratorBind(&it, ring);
+
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  osalDbgCheck(NandRingIteratorFinished(&it));
+  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2 + 1);
+  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
+  osalDbgCheck(session.last_page == 63);
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+
+  NandRingIteratorRelease(&it);
+
+
+  nandRingUmount(ring);
+  chHeapFree(pagebuf);
+}
+
+
+/*
+ ******************************************************************************
+ * EXPORTED FUNCTIONS
+ ******************************************************************************
+ */
+
+/**
+ * @brief   Stream every session page by page with and without
+ *          read-ahead.
+ */
+void iterator_cursor(NandRing *ring) {
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *buffers = chHeapAlloc(NULL, 2 * pds);
+  /* only the newest session may end in the middle of block */
+  const size_t pages[] = {3 * ppb, 5 * ppb, 2 * ppb + 9};
+  const size_t sessions = sizeof(pages) / sizeof(pages[0]);
+  size_t seed[sizeof(pages) / sizeof(pages[0])];
+  NandRingIterator it;
+  NandRingSession session;
+  NandRingCursor cur;
+  NandPageHeader header;
+  const uint8_t *data;
+
+  uint32_t log2ppb = 0;
+  while ((1U << log2ppb) < ppb)
+    log2ppb++;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+
+  size_t total = 0;
+  for (size_t s=0; s<sessions; s++) {
+    if (s > 0)
+      nandRingUmount(ring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    seed[s] = total;
+    for (size_t p=0; p<pages[s]; p++) {
+      fill_page(pagebuf, pds, total++);
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+  }
+
+  for (size_t mode=0; mode<2; mode++) {
+    NandRingIteratorBind(&it, ring);
+    size_t s = sessions;
+    while (OSAL_SUCCESS == NandRingIteratorNext(&it, &session)) {
+      s--;
+      nandRingCursorStart(&cur, ring, &session, buffers,
+                          (0 == mode) ? NULL : CursorWA, sizeof(CursorWA));
+      size_t n = 0;
+      uint64_t id = 0;
+      while (NAND_RING_READ_END != nandRingCursorNext(&cur, &data, &header)) {
+        osalDbgCheck(n < pages[s]);
+        fill_page(pagebuf, pds, seed[s] + n);
+        osalDbgCheck(0 == memcmp(pagebuf, data, pds));
+        osalDbgCheck(id < header.id);
+        id = header.id;
+        n++;
+      }
+      osalDbgCheck((NULL == data) && (n == pages[s]));
+      /* the end is sticky */
+      osalDbgCheck(NAND_RING_READ_END == nandRingCursorNext(&cur, &data, &header));
+      nandRingCursorStop(&cur);
+    }
+    osalDbgCheck(0 == s);
+    /* head comes from mount, older sessions cost page search and few
+       header reads each */
+    osalDbgCheck(it.spare_reads <= sessions * (log2ppb + 6));
+    NandRingIteratorRelease(&it);
+  }
+
+  /* cursor stopped in the middle of session */
+  NandRingIteratorBind(&it, ring);
+  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
+  nandRingCursorStart(&cur, ring, &session, buffers, CursorWA, sizeof(CursorWA));
+  osalDbgCheck(NAND_RING_READ_OK == nandRingCursorNext(&cur, &data, NULL));
+  nandRingCursorStop(&cur);
+  NandRingIteratorRelease(&it);
+
+  nandRingUmount(ring);
+  nandRingErase(ring);
+  chHeapFree(buffers);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Find pages by time in sessions with and without UTC
+ *          correction, including correction acquired in the middle of
+ *          session.
+ */
+void iterator_seek_time(NandRing *ring) {
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *buffers = chHeapAlloc(NULL, 2 * pds);
+  /* only the newest session may end in the middle of block */
+  const size_t pages[] = {3 * ppb, 4 * ppb, 2 * ppb + 9};
+  const uint32_t correction[] = {0, 1700000000, 1700003600};
+  const size_t sessions = sizeof(pages) / sizeof(pages[0]);
+  NandRingIterator it;
+  NandRingSession session;
+  NandRingCursor cur;
+  NandPageHeader header;
+  const uint8_t *data;
+  uint32_t blk, page;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+
+  /* second session gets its correction in the middle */
+  memset(pagebuf, 0x55, pds);
+  for (size_t s=0; s<sessions; s++) {
+    if (s > 0)
+      nandRingUmount(ring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    nandRingSetUtcCorrection(ring, (1 == s) ? 0 : correction[s]);
+    for (size_t p=0; p<pages[s]; p++) {
+      if ((1 == s) && (p == pages[s] / 3))
+        nandRingSetUtcCorrection(ring, correction[s]);
+      /* runs of pages share time stamp */
+      if (0 == (p % 3))
+        chThdSleepMilliseconds(1);
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+  }
+
+  uint32_t log2len = 0;
+  while ((1U << log2len) < ring->config->len)
+    log2len++;
+  uint32_t log2ppb = 0;
+  while ((1U << log2ppb) < ppb)
+    log2ppb++;
+
+  NandRingIteratorBind(&it, ring);
+  size_t s = sessions;
+  while (OSAL_SUCCESS == NandRingIteratorNext(&it, &session)) {
+    s--;
+    osalDbgCheck(correction[s] == session.utc_correction);
+
+    /* time span of session */
+    nandRingCursorStart(&cur, ring, &session, buffers, NULL, 0);
+    osalDbgCheck(NAND_RING_READ_OK == nandRingCursorNext(&cur, &data, &header));
+    const uint64_t first = nandRingPageTime(&session, &header);
+    uint64_t last = first;
+    while (NAND_RING_READ_END != nandRingCursorNext(&cur, &data, &header))
+      last = nandRingPageTime(&session, &header);
+    nandRingCursorStop(&cur);
+    osalDbgCheck((first < last) && (first > 2000));
+
+    for (size_t i=0; i<20; i++) {
+      const uint64_t t = first - 2000 + rand() % (last - first + 4000);
+
+      /* the first page at or after t found by reading whole session */
+      uint64_t expect = 0;
+      nandRingCursorStart(&cur, ring, &session, buffers, NULL, 0);
+      while (NAND_RING_READ_END != nandRingCursorNext(&cur, &data, &header)) {
+        if (nandRingPageTime(&session, &header) >= t) {
+          expect = header.id;
+          break;
+        }
+      }
+      nandRingCursorStop(&cur);
+
+      const uint32_t reads = ring->dbg.spare_reads;
+      if (0 == expect) {
+        osalDbgCheck(OSAL_FAILED == nandRingSeekTime(ring, &session, t, &blk, &page));
+        continue;
+      }
+      osalDbgCheck(OSAL_SUCCESS == nandRingSeekTime(ring, &session, t, &blk, &page));
+      osalDbgCheck(ring->dbg.spare_reads - reads <= log2len + log2ppb + 2);
+      osalDbgCheck(nandRingPageHeader(ring, blk, page, &header));
+      osalDbgCheck(expect == header.id);
+
+      osalDbgCheck(OSAL_SUCCESS == nandRingCursorStartTime(&cur, ring, &session, t,
+                                   buffers, CursorWA, sizeof(CursorWA)));
+      osalDbgCheck(NAND_RING_READ_OK == nandRingCursorNext(&cur, &data, &header));
+      osalDbgCheck(expect == header.id);
+      nandRingCursorStop(&cur);
+
+      /* start page id costs single header read on top of the seek */
+      const uint32_t start_reads = ring->dbg.spare_reads;
+      osalDbgCheck(OSAL_SUCCESS == nandRingCursorStartTime(&cur, ring, &session, t,
+                                   buffers, NULL, 0));
+      osalDbgCheck(ring->dbg.spare_reads - start_reads <= log2len + log2ppb + 3);
+      osalDbgCheck(NAND_RING_READ_OK == nandRingCursorNext(&cur, &data, &header));
+      osalDbgCheck(expect == header.id);
+      nandRingCursorStop(&cur);
+    }
+
+    /* before the start and after the end of session */
+    osalDbgCheck(OSAL_SUCCESS == nandRingSeekTime(ring, &session, 0, &blk, &page));
+    osalDbgCheck((session.first_blk == blk) && (0 == page));
+    osalDbgCheck(OSAL_FAILED == nandRingSeekTime(ring, &session, last + 1, &blk, &page));
+    osalDbgCheck(OSAL_FAILED == nandRingCursorStartTime(&cur, ring, &session, last + 1,
+                                buffers, NULL, 0));
+  }
+  osalDbgCheck(0 == s);
+  NandRingIteratorRelease(&it);
+
+  nandRingUmount(ring);
+  nandRingErase(ring);
+  chHeapFree(buffers);
+  chHeapFree(pagebuf);
+}
+
+/**
+ * @brief   Session table must match sessions read by iterator.
+ */
+static void compare_session_table(NandRing *ring) {
+  const size_t count = nandRingSessionCount(ring);
+  NandRingIterator it;
+  NandRingSession a, b;
+  size_t n = 0;
+
+  NandRingIteratorBind(&it, ring);
+  while (OSAL_SUCCESS == NandRingIteratorNext(&it, &a)) {
+    if (n < count) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingSessionGet(ring, n, &b));
+      osalDbgCheck((a.id == b.id) && (a.time_boot_us == b.time_boot_us)
+                   && (a.utc_correction == b.utc_correction)
+                   && (a.first_blk == b.first_blk) && (a.last_blk == b.last_blk)
+                   && (a.last_page == b.last_page) && (a.pages == b.pages));
+    }
+    n++;
+  }
+  NandRingIteratorRelease(&it);
+
+  if (count < ring->config->sessions_len)
+    osalDbgCheck(n == count);
+  else
+    osalDbgCheck(n >= count);
+  osalDbgCheck(OSAL_FAILED == nandRingSessionGet(ring, count, &b));
+}
+
+/**
+ * @brief   Session table maintained while writing sessions which wrap
+ *          the ring several times.
+ */
+void iterator_session_table(NandRing *ring) {
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  const uint32_t len = ring->config->len;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  NandRingSession table[5];
+  NandRingSession session;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+  cfg->sessions = table;
+  cfg->sessions_len = sizeof(table) / sizeof(table[0]);
+  memset(pagebuf, 0x5A, pds);
+
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  osalDbgCheck(0 == nandRingSessionCount(ring));
+  osalDbgCheck(OSAL_FAILED == nandRingSessionGet(ring, 0, &session));
+  nandRingUmount(ring);
+
+  /* only the newest session may end in the middle of block */
+  for (size_t s=0; s<16; s++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    compare_session_table(ring);
+    nandRingSetUtcCorrection(ring, s);
+    const size_t blocks = 1 + rand() % (len / 4);
+    for (size_t b=0; b<blocks; b++) {
+      for (size_t p=0; p<ppb; p++)
+        osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+      compare_session_table(ring);
+    }
+    osalDbgCheck(OSAL_SUCCESS == nandRingSessionGet(ring, 0, &session));
+    osalDbgCheck((blocks * ppb == session.pages) && (s == session.utc_correction));
+    nandRingUmount(ring);
+  }
+
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<ppb+9; p++)
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+  compare_session_table(ring);
+  osalDbgCheck(cfg->sessions_len == nandRingSessionCount(ring));
+  nandRingUmount(ring);
 
+  /* closing the newest session discards its last page */
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  compare_session_table(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingSessionGet(ring, 0, &session));
+  osalDbgCheck(ppb + 8 == session.pages);
   nandRingUmount(ring);
+
+  cfg->sessions = NULL;
+  cfg->sessions_len = 0;
+  nandRingErase(ring);
   chHeapFree(pagebuf);
 }
 
+static bool same_session(const NandRingSession *a, const NandRingSession *b) {
+  return (a->id == b->id) && (a->time_boot_us == b->time_boot_us)
+      && (a->utc_correction == b->utc_correction)
+      && (a->first_blk == b->first_blk) && (a->last_blk == b->last_blk)
+      && (a->last_page == b->last_page) && (a->pages == b->pages);
+}
+
 /**
- * @brief iterator_multisession_overlap
- * @param ring
+ * @brief   Sessions listed oldest first must be the same as listed by
+ *          backward iterator, stepping in both directions must agree.
  */
-void iterator_multisession_overlap(NandRing *ring) {
-  const size_t start = ring->config->start_blk;
-  const size_t len   = ring->config->len;
+void iterator_forward(NandRing *ring) {
   NANDDriver *nandp  = ring->config->nandp;
   const size_t ppb = nandp->config->pages_per_block;
   const size_t pds = nandp->config->page_data_size;
+  const uint32_t len = ring->config->len;
   uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  const size_t max = 24;
+  NandRingSession *list = chHeapAlloc(NULL, max * sizeof(NandRingSession));
+  uint64_t first_id[24];
+  size_t pages[24];
   NandRingIterator it;
-  NandRingSession session;
-  const size_t N1 = 12;
-  const size_t N2 = 24;
-  size_t N3;
+  NandRingSession session, step;
+  size_t n;
+
+  uint32_t log2len = 0;
+  while ((1U << log2len) < len)
+    log2len++;
+  uint32_t log2ppb = 0;
+  while ((1U << log2ppb) < ppb)
+    log2ppb++;
 
   osalDbgCheck(is_sequence_good(ring));
-  nandEraseRange(nandp, start, len);
+  nandRingErase(ring);
+  memset(pagebuf, 0x3C, pds);
 
-  /* 2 sessions not full ring */
-  nandRingMount(ring);
-  for (size_t b=0; b<N1; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
-    }
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  NandRingIteratorBindForward(&it, ring);
+  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(OSAL_FAILED == nandRingSessionOldest(ring, &session));
+  osalDbgCheck(OSAL_FAILED == nandRingSessionNewest(ring, &session));
+  nandRingUmount(ring);
+
+  /* full blocks only, so backward iterator sees every session */
+  for (size_t s=0; s<4; s++) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    nandRingSetUtcCorrection(ring, s);
+    for (size_t p=0; p<(s + 1) * ppb; p++)
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    nandRingUmount(ring);
+  }
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<ppb+5; p++)
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+
+  /* iterator leaves bus to caller in both directions, like mount */
+  n = 0;
+  nandAcquireBus(nandp);
+  NandRingIteratorBindForward(&it, ring);
+  while (OSAL_SUCCESS == NandRingIteratorNext(&it, &list[n]))
+    n++;
+  osalDbgCheck(5 == n);
+  osalDbgCheck(it.spare_reads <= n * (2 * log2len + log2ppb + 8));
+  NandRingIteratorRelease(&it);
+  NandRingIteratorBind(&it, ring);
+  while (OSAL_SUCCESS == NandRingIteratorNext(&it, &session)) {
+    osalDbgCheck(n > 0);
+    osalDbgCheck(same_session(&session, &list[--n]));
   }
+  osalDbgCheck(0 == n);
+  NandRingIteratorRelease(&it);
+  nandReleaseBus(nandp);
   nandRingUmount(ring);
-  nandRingMount(ring);
-  for (size_t b=0; b<N2; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
+
+  /* sessions of any length wrapping the ring */
+  nandRingErase(ring);
+  size_t total = 0;
+  size_t s = 0;
+  while (total < (len * ppb * 3) / 2) {
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    first_id[s % max] = ring->cur_id;
+    pages[s % max] = 1 + rand() % (4 * ppb);
+    for (size_t p=0; p<pages[s % max]; p++)
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    total += pages[s % max];
+    s++;
+    if (s % 3)
+      nandRingUmount(ring);
+    else {
+      /* newest session read while it is being written */
+      osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewest(ring, &session));
+      osalDbgCheck((first_id[(s - 1) % max] == session.id)
+                   && (pages[(s - 1) % max] == session.pages)
+                   && (ring->head_blk == session.last_blk)
+                   && (ring->head_page == session.last_page));
+      nandRingUmount(ring);
     }
   }
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+
+  n = 0;
+  NandRingIteratorBindForward(&it, ring);
+  while (OSAL_SUCCESS == NandRingIteratorNext(&it, &list[n % max]))
+    n++;
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(n > max / 2);
+
+  /* the newest sessions survive completely, closing discards last page
+     of session ending in the middle of block */
+  for (size_t i=1; i<max/2; i++) {
+    const NandRingSession *got = &list[(n - i) % max];
+    const size_t idx = (s - i) % max;
+    const size_t expect = (0 == pages[idx] % ppb) ? pages[idx] : pages[idx] - 1;
+    if (0 == expect)
+      break;
+    osalDbgCheck((first_id[idx] == got->id) && (expect == got->pages));
+  }
 
-  /* write third session to overlap first session */
-  nandRingUmount(ring);
-  nandRingMount(ring);
-  N3 = NAND_TEST_LEN - N1 - N2 + N1/2;
-  for (size_t b=0; b<N3; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
-    }
+  /* walk both ways from the newest session */
+  osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewest(ring, &session));
+  osalDbgCheck(same_session(&session, &list[(n - 1) % max]));
+  for (size_t i=2; i<max; i++) {
+    const uint32_t reads = ring->dbg.spare_reads;
+    if (OSAL_SUCCESS != nandRingSessionOlder(ring, &session, &step))
+      break;
+    osalDbgCheck(ring->dbg.spare_reads - reads <= 2 * log2len + log2ppb + 8);
+    osalDbgCheck(same_session(&step, &list[(n - i) % max]));
+    osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewer(ring, &step, &session));
+    osalDbgCheck(same_session(&session, &list[(n - i + 1) % max]));
+    session = step;
   }
+  osalDbgCheck(OSAL_FAILED == nandRingSessionNewer(ring, &list[(n - 1) % max], &step));
+  nandRingUmount(ring);
 
+  /* single session overwriting its own beginning */
+  nandRingErase(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<(len + len / 2) * ppb + 7; p++)
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
   NandRingIteratorBind(&it, ring);
-
   osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1/2 - 1);
-  osalDbgCheck(session.last_page == 63);
+  NandRingIteratorRelease(&it);
+  osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewest(ring, &step));
+  osalDbgCheck(same_session(&session, &step));
+  osalDbgCheck(OSAL_SUCCESS == nandRingSessionOldest(ring, &step));
+  osalDbgCheck(same_session(&session, &step));
+  osalDbgCheck(OSAL_FAILED == nandRingSessionOlder(ring, &session, &step));
+  osalDbgCheck(OSAL_FAILED == nandRingSessionNewer(ring, &session, &step));
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
-  osalDbgCheck(session.last_page == 63);
+  nandRingUmount(ring);
+  nandRingErase(ring);
+  chHeapFree(list);
+  chHeapFree(pagebuf);
+}
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1/2 + 1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
-  osalDbgCheck(session.last_page == 63);
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
-  NandRingIteratorRelease(&it);
+/**
+ * @brief   Write page holding NAND bus, the way log worker does it.
+ */
+static bool write_locked(NandRing *ring, const uint8_t *data) {
+  NANDDriver *nandp  = ring->config->nandp;
 
+  nandAcquireBus(nandp);
+  const bool ret = nandRingWritePage(ring, data);
+  nandReleaseBus(nandp);
 
-  /* write third session over the whole first session */
-  N3 = N1/2;
-  for (size_t b=0; b<N3; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
-    }
-  }
+  return ret;
+}
 
-  NandRingIteratorBind(&it, ring);
+/**
+ * @brief   Read sessions while ring keeps writing: cursor stops at
+ *          session end captured at start and reports blocks overwritten
+ *          under it.
+ */
+void iterator_concurrent(NandRing *ring) {
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  const uint32_t len = ring->config->len;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *buffers = chHeapAlloc(NULL, 2 * pds);
+  NandRingSession session;
+  NandRingCursor cur;
+  NandPageHeader header;
+  const uint8_t *data;
+  size_t total = 0;
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 - 1);
-  osalDbgCheck(session.last_page == 63);
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + 1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
-  osalDbgCheck(session.last_page == 63);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<2*ppb; p++) {
+    fill_page(pagebuf, pds, total++);
+    osalDbgCheck(OSAL_SUCCESS == write_locked(ring, pagebuf));
+  }
+  nandRingUmount(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<ppb+3; p++) {
+    fill_page(pagebuf, pds, total++);
+    osalDbgCheck(OSAL_SUCCESS == write_locked(ring, pagebuf));
+  }
 
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
+  /* newest session grows under cursor, read-ahead worker shares bus
+     with writer */
+  osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewest(ring, &session));
+  osalDbgCheck(ppb + 3 == session.pages);
+  nandRingCursorStart(&cur, ring, &session, buffers, CursorWA, sizeof(CursorWA));
+  nand_ring_read_t status;
+  size_t n = 0;
+  while (NAND_RING_READ_END != (status = nandRingCursorNext(&cur, &data, &header))) {
+    osalDbgCheck(NAND_RING_READ_OK == status);
+    fill_page(pagebuf, pds, 2 * ppb + n);
+    osalDbgCheck(0 == memcmp(pagebuf, data, pds));
+    osalDbgCheck(session.id + n == header.id);
+    n++;
+    fill_page(pagebuf, pds, total++);
+    osalDbgCheck(OSAL_SUCCESS == write_locked(ring, pagebuf));
+  }
+  osalDbgCheck(session.pages == n);
+  nandRingCursorStop(&cur);
+
+  /* writer wraps onto the oldest session being read */
+  osalDbgCheck(OSAL_SUCCESS == nandRingSessionOldest(ring, &session));
+  osalDbgCheck(2 * ppb == session.pages);
+  nandRingCursorStart(&cur, ring, &session, buffers, NULL, 0);
+  for (n=0; n<3; n++) {
+    osalDbgCheck(NAND_RING_READ_OK == nandRingCursorNext(&cur, &data, &header));
+    osalDbgCheck(session.id + n == header.id);
+  }
+  for (size_t p=0; p<len*ppb; p++) {
+    fill_page(pagebuf, pds, total++);
+    osalDbgCheck(OSAL_SUCCESS == write_locked(ring, pagebuf));
+  }
+  osalDbgCheck(NAND_RING_READ_OVERWRITTEN == nandRingCursorNext(&cur, &data, &header));
+  osalDbgCheck(NAND_RING_READ_END == nandRingCursorNext(&cur, &data, &header));
+  osalDbgCheck(NULL == data);
+  nandRingCursorStop(&cur);
 
-  NandRingIteratorRelease(&it);
+  nandRingUmount(ring);
+  nandRingErase(ring);
+  chHeapFree(buffers);
+  chHeapFree(pagebuf);
+}
 
+/**
+ * @brief   Writes numbered pages holding NAND bus for every page.
+ */
+static THD_FUNCTION(WriterThread, arg) {
+  chRegSetThreadName("NandWriter");
+  TestWriter *w = arg;
+  const size_t pds = w->ring->config->nandp->config->page_data_size;
+
+  for (size_t p=0; p<w->total; p++) {
+    fill_page(w->buf, pds, p);
+    osalDbgCheck(OSAL_SUCCESS == write_locked(w->ring, w->buf));
+    w->written = p + 1;
+  }
 
-  /* write third session over the half of second session */
-  N3 = N2/2;
-  for (size_t b=0; b<N3; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
+  chThdExit(MSG_OK);
+}
+
+/**
+ * @brief   Public readers take NAND bus, so they may run while writer
+ *          thread programs pages. Page being written must be either
+ *          absent or complete.
+ */
+void read_concurrent(NandRing *ring) {
+  NANDDriver *nandp  = ring->config->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *readbuf = chHeapAlloc(NULL, pds);
+  TestWriter w = {ring, chHeapAlloc(NULL, pds), 3 * ppb, 0};
+  NandPageHeader header;
+  uint32_t blk, page;
+  size_t reads = 0;
+
+  osalDbgCheck(is_sequence_good(ring));
+  nandRingErase(ring);
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  const uint64_t first_id = ring->cur_id;
+  const uint32_t pages_read = ring->dbg.pages_read;
+
+  thread_t *writer = chThdCreateStatic(WriterWA, sizeof(WriterWA),
+                       chThdGetPriorityX(), WriterThread, &w);
+  for (size_t p=0; p<w.total; p++) {
+    while (w.written <= p)
+      chThdSleepMilliseconds(1);
+
+    osalDbgCheck(OSAL_SUCCESS == nandRingSeekId(ring, first_id + p, &blk, &page));
+    osalDbgCheck(nandRingPageHeader(ring, blk, page, &header));
+    osalDbgCheck(first_id + p == header.id);
+    osalDbgCheck(NAND_RING_READ_OK == nandRingReadPage(ring, blk, page, readbuf, &header));
+    fill_page(pagebuf, pds, p);
+    osalDbgCheck(0 == memcmp(pagebuf, readbuf, pds));
+    reads++;
+
+    nandRingNextPage(ring, &blk, &page);
+    const nand_ring_read_t status = nandRingReadPage(ring, blk, page, readbuf, &header);
+    if (NAND_RING_READ_NO_DATA != status) {
+      osalDbgCheck(NAND_RING_READ_OK == status);
+      osalDbgCheck(first_id + p + 1 == header.id);
+      fill_page(pagebuf, pds, p + 1);
+      osalDbgCheck(0 == memcmp(pagebuf, readbuf, pds));
+      reads++;
     }
   }
+  chThdWait(writer);
+  osalDbgCheck(pages_read + reads == ring->dbg.pages_read);
 
-  NandRingIteratorBind(&it, ring);
+  nandRingUmount(ring);
+  nandRingErase(ring);
+  chHeapFree(w.buf);
+  chHeapFree(readbuf);
+  chHeapFree(pagebuf);
+}
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(! NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2/2 - 1);
-  osalDbgCheck(session.last_page == 63);
+/**
+ * @brief   Count every page as single record typed by its first byte.
+ */
+static void count_pages(NandBlockSummary *summary, const uint8_t *data,
+                        const NandPageHeader *header) {
+  (void)header;
+  summary->records++;
+  summary->types[data[0] % NAND_RING_SUMMARY_TYPES]++;
+}
 
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2/2 + 1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
-  osalDbgCheck(session.last_page == 63);
+/**
+ * @brief   Records count at which fail_summary() breaks NAND.
+ */
+static uint32_t summary_fail_records;
 
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+/**
+ * @brief   Make every NAND operation fail right before block summary.
+ */
+static void fail_summary(NandBlockSummary *summary, const uint8_t *data,
+                         const NandPageHeader *header) {
+  count_pages(summary, data, header);
+  if (summary_fail_records == summary->records)
+    __nandSetErrorChance(1);
+}
 
-  NandRingIteratorRelease(&it);
+/**
+ * @brief   Every full block carries summary of its data pages. Summary
+ *          pages are invisible for cursor, range queries read single
+ *          page per block.
+ */
+void iterator_block_summary(NandRing *ring) {
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  NANDDriver *nandp  = cfg->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  /* data pages per block */
+  const size_t dpb = ppb - 1;
+  const size_t blocks = 5;
+  const size_t total_pages = blocks * dpb + 4;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
+  uint8_t *buffers = chHeapAlloc(NULL, 2 * pds);
+  uint32_t types[NAND_RING_SUMMARY_TYPES];
+  NandBlockSummary summary, total, middle;
+  NandRingSession session;
+  NandRingCursor cur;
+  NandPageHeader header;
+  const uint8_t *data;
+  uint32_t blk, page;
 
+  uint32_t log2len = 0;
+  while ((1U << log2len) < cfg->len)
+    log2len++;
 
-  /* write third session over the whole second session */
-  N3 = N2/2;
-  for (size_t b=0; b<N3; b++) {
-    for (size_t i=0; i<ppb; i++) {
-      bool status = nandRingWritePage(ring, pagebuf);
-      osalDbgCheck(OSAL_SUCCESS == status);
+  osalDbgCheck(is_sequence_good(ring));
+  memset(&middle, 0, sizeof(middle));
+  cfg->block_summary = true;
+  cfg->summary_cb = count_pages;
+
+  for (size_t mode=0; mode<2; mode++) {
+    cfg->write_mode = (0 == mode) ? NAND_RING_WRITE_SPLIT : NAND_RING_WRITE_WHOLE;
+    nandRingErase(ring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    for (size_t p=0; p<total_pages; p++) {
+      chThdSleepMilliseconds(1);
+      fill_page(pagebuf, pds, p);
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    }
+    osalDbgCheck(blocks == ring->dbg.summary_writes);
+
+    /* summary occupies id like any other page */
+    osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewest(ring, &session));
+    osalDbgCheck(total_pages + blocks == session.pages);
+
+    blk = session.first_blk;
+    for (size_t b=0; b<blocks; b++) {
+      osalDbgCheck(OSAL_SUCCESS == nandRingBlockSummary(ring, blk, &summary));
+      memset(types, 0, sizeof(types));
+      for (size_t p=b*dpb; p<(b+1)*dpb; p++) {
+        fill_page(pagebuf, pds, p);
+        types[pagebuf[0] % NAND_RING_SUMMARY_TYPES]++;
+      }
+      osalDbgCheck((session.id + b * ppb == summary.first_id)
+                   && (summary.first_id + dpb - 1 == summary.last_id)
+                   && (dpb == summary.records)
+                   && (0 == memcmp(types, summary.types, sizeof(types)))
+                   && (summary.time_min_us < summary.time_max_us));
+      if (2 == b)
+        middle = summary;
+      page = ppb - 1;
+      nandRingNextPage(ring, &blk, &page);
     }
+    /* block being written has no summary yet */
+    osalDbgCheck(session.last_blk == blk);
+    osalDbgCheck(OSAL_FAILED == nandRingBlockSummary(ring, blk, &summary));
+
+    /* cursor returns data pages only */
+    nandRingCursorStart(&cur, ring, &session, buffers, CursorWA, sizeof(CursorWA));
+    size_t n = 0;
+    while (NAND_RING_READ_END != nandRingCursorNext(&cur, &data, &header)) {
+      osalDbgCheck(NAND_RING_SUMMARY_PAGE != header.first_record);
+      fill_page(pagebuf, pds, n);
+      osalDbgCheck(0 == memcmp(pagebuf, data, pds));
+      n++;
+    }
+    nandRingCursorStop(&cur);
+    osalDbgCheck(total_pages == n);
+
+    /* whole session, the last block must be scanned by caller */
+    osalDbgCheck(1 == nandRingSummaryRange(ring, &session, 0, UINT64_MAX, &total));
+    osalDbgCheck((session.id == total.first_id)
+                 && (session.id + blocks * ppb - 2 == total.last_id)
+                 && (blocks * dpb == total.records));
+
+    /* single block range costs bisection and few summaries */
+    const uint64_t correction = (uint64_t)session.utc_correction * 1000000;
+    const uint32_t reads = ring->dbg.spare_reads;
+    osalDbgCheck(0 == nandRingSummaryRange(ring, &session,
+                                           correction + middle.time_min_us,
+                                           correction + middle.time_max_us,
+                                           &total));
+    osalDbgCheck(ring->dbg.spare_reads - reads <= 2 * log2len + 4);
+    osalDbgCheck((middle.first_id == total.first_id)
+                 && (middle.last_id == total.last_id)
+                 && (dpb == total.records));
+
+    /* nothing after the end of session */
+    osalDbgCheck(nandRingPageHeader(ring, session.last_blk, session.last_page,
+                                    &header));
+    nandRingSummaryRange(ring, &session, nandRingPageTime(&session, &header) + 1,
+                         UINT64_MAX, &total);
+    osalDbgCheck(0 == total.first_id);
+
+    /* session closed right after summary page keeps it */
+    nandRingUmount(ring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    for (size_t p=0; p<dpb; p++)
+      osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+    nandRingUmount(ring);
+    osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+    osalDbgCheck(OSAL_SUCCESS == nandRingSessionNewest(ring, &session));
+    osalDbgCheck((ppb == session.pages) && (ppb - 1 == session.last_page));
+    osalDbgCheck(OSAL_SUCCESS == nandRingBlockSummary(ring, session.first_blk, &summary));
+    osalDbgCheck((session.id == summary.first_id) && (dpb == summary.records));
+    nandRingUmount(ring);
   }
 
-  NandRingIteratorBind(&it, ring);
-
-  osalDbgCheck(OSAL_SUCCESS == NandRingIteratorNext(&it, &session));
-  osalDbgCheck(NandRingIteratorFinished(&it));
-  osalDbgCheck(session.first_blk == NAND_TEST_START_BLOCK + N1 + N2 + 1);
-  osalDbgCheck(session.last_blk == NAND_TEST_START_BLOCK + N1 + N2 - 1);
-  osalDbgCheck(session.last_page == 63);
-  osalDbgCheck(OSAL_FAILED == NandRingIteratorNext(&it, &session));
+  cfg->write_mode = NAND_RING_WRITE_SPLIT;
+  cfg->block_summary = false;
+  cfg->summary_cb = NULL;
+  nandRingErase(ring);
+  chHeapFree(buffers);
+  chHeapFree(pagebuf);
+}
 
-  NandRingIteratorRelease(&it);
+/**
+ * @brief   Summary page which can not be stored must fail the write
+ *          of its data page although that page is stored.
+ */
+void iterator_summary_failed(NandRing *ring) {
+  NandRingConfig *cfg = (NandRingConfig *)ring->config;
+  NANDDriver *nandp  = cfg->nandp;
+  const size_t ppb = nandp->config->pages_per_block;
+  const size_t pds = nandp->config->page_data_size;
+  uint8_t *pagebuf = chHeapAlloc(NULL, pds);
 
+  osalDbgCheck(is_sequence_good(ring));
+  cfg->block_summary = true;
+  cfg->summary_cb = fail_summary;
+  summary_fail_records = ppb - 1;
+  nandRingErase(ring);
 
+  /* rescue of summary page can not find any good block */
+  osalDbgCheck(OSAL_SUCCESS == nandRingMount(ring));
+  for (size_t p=0; p<ppb-2; p++) {
+    fill_page(pagebuf, pds, p);
+    osalDbgCheck(OSAL_SUCCESS == nandRingWritePage(ring, pagebuf));
+  }
+  fill_page(pagebuf, pds, ppb - 2);
+  osalDbgCheck(OSAL_FAILED == nandRingWritePage(ring, pagebuf));
+  __nandSetErrorChance(0);
+  osalDbgCheck(NAND_RING_NO_SPACE == ring->state);
+  osalDbgCheck((1 == ring->dbg.summary_failed) && (0 == ring->dbg.summary_writes));
+  osalDbgCheck(ppb - 2 == ring->head_page);
   nandRingUmount(ring);
-  chHeapFree(pagebuf);
-}
 
+  /* bring back blocks marked bad by injected errors */
+  const NANDConfig *nandcfg = nandp->config;
+  bitmap_t *bb_map = nandp->bb_map;
+  __nandEraseRangeForce(nandp, cfg->start_blk, cfg->len);
+  nandStop(nandp);
+  nandStart(nandp, nandcfg, bb_map);
+  osalDbgCheck(is_sequence_good(ring));
 
-/*
- ******************************************************************************
- * EXPORTED FUNCTIONS
- ******************************************************************************
- */
+  cfg->block_summary = false;
+  cfg->summary_cb = NULL;
+  chHeapFree(pagebuf);
+}
 
 /**
  *
@@ -899,6 +2471,21 @@ void nandRingIteratorTest(NANDDriver *nandp, const NANDConfig *config, bitmap_t
   iterator_multisession(&nandring, 1);
   iterator_multisession(&nandring, 0);
   iterator_multisession_overlap(&nandring);
+  iterator_cursor(&nandring);
+  iterator_seek_time(&nandring);
+  iterator_session_table(&nandring);
+  iterator_forward(&nandring);
+  iterator_concurrent(&nandring);
+  read_concurrent(&nandring);
+  iterator_block_summary(&nandring);
+  iterator_summary_failed(&nandring);
+
+  nandringcfg.write_mode = NAND_RING_WRITE_WHOLE;
+  iterator_single_session(&nandring);
+  iterator_multisession(&nandring, 1);
+  iterator_multisession_overlap(&nandring);
+  iterator_session_table(&nandring);
+  nandringcfg.write_mode = NAND_RING_WRITE_SPLIT;
 
   nandRingStop(&nandring);
   chHeapFree(ring_working_area);
@@ -922,8 +2509,57 @@ void nandRingTest(NANDDriver *nandp, const NANDConfig *config, bitmap_t *bb_map)
 
   mount_erased(&nandring);
   mount_trashed(&nandring);
+  mount_other_format(&nandring);
+  write_page_test(&nandring);
+  mount_erased_with_bad(&nandring);
+
+  nandringcfg.mount_mode = NAND_RING_MOUNT_SEARCH;
+  mount_erased(&nandring);
+  mount_trashed(&nandring);
+  mount_other_format(&nandring);
   write_page_test(&nandring);
   mount_erased_with_bad(&nandring);
+  nandringcfg.mount_mode = NAND_RING_MOUNT_BRUTE_FORCE;
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  mount_bad_run(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  mount_search_vs_brute(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  mount_search_last_page(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  mount_checkpoint(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  write_whole_test(&nandring);
+
+  nandringcfg.write_mode = NAND_RING_WRITE_WHOLE;
+  write_page_test(&nandring);
+  nandringcfg.write_mode = NAND_RING_WRITE_SPLIT;
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  erase_ahead_test(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  write_pages_test(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  read_page_test(&nandring);
+
+  nandStop(nandp);
+  nandStart(nandp, config, bb_map);
+  seek_id_test(&nandring);
 
   nandStop(nandp);
   nandStart(nandp, config, bb_map);
@@ -0,0 +1,105 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "soft_ecc.h"
+
+/*
+  Name  : Hamming code, single error correction, double error detection
+  Layout: pairs of parity bits (P', P) starting from LSB. First 3 pairs
+          are column parities (bit number inside byte), the rest are line
+          parities (byte number inside buffer). P covers bits/bytes with
+          corresponding address bit set, P' covers the others.
+          This is the same layout as FSMC hardware ECC produces.
+  MaxLen: 2^13 bytes, buffer length must be power of 2
+*/
+
+/**
+ *
+ */
+static uint32_t parity8(uint8_t b) {
+  b ^= b >> 4;
+  b ^= b >> 2;
+  b ^= b >> 1;
+  return b & 1;
+}
+
+/**
+ * @brief   Calculate ECC in the same manner as FSMC does during
+ *          page data programming.
+ */
+uint32_t softecc(const uint8_t *buf, size_t len) {
+  uint8_t col = 0;    /* xor of all bytes */
+  uint32_t line = 0;  /* xor of numbers of bytes with odd parity */
+  uint32_t odd = 0;   /* parity of the whole buffer */
+  uint32_t ecc = 0;
+  size_t pair = 0;
+
+  for (size_t i=0; i<len; i++) {
+    col ^= buf[i];
+    if (parity8(buf[i])) {
+      line ^= i;
+      odd ^= 1;
+    }
+  }
+
+  for (size_t j=0; j<3; j++, pair++) {
+    uint8_t mask = 0;
+    for (size_t k=0; k<8; k++) {
+      if (k & (1U << j))
+        mask |= 1U << k;
+    }
+    ecc |= parity8(col & ~mask) << (2 * pair);
+    ecc |= parity8(col & mask) << (2 * pair + 1);
+  }
+
+  for (size_t n=1; n<len; n<<=1, pair++) {
+    const uint32_t p = (line & n) ? 1 : 0;
+    ecc |= (odd ^ p) << (2 * pair);
+    ecc |= p << (2 * pair + 1);
+  }
+
+  return ecc;
+}
+
+/**
+ * @brief   Check data against ECC stored during programming and fix
+ *          single bit error in place.
+ * @param[in] stored  ECC calculated when data was programmed
+ * @param[in] calc    ECC of data as it was read back
+ */
+softecc_status_t softecc_correct(uint8_t *buf, size_t len,
+                                 uint32_t stored, uint32_t calc) {
+  size_t pairs = 3;
+
+  for (size_t n=1; n<len; n<<=1)
+    pairs++;
+  const uint32_t mask = (pairs >= 16) ? 0xFFFFFFFF : ((1UL << (2 * pairs)) - 1);
+  const uint32_t syndrome = (stored ^ calc) & mask;
+  const uint32_t even = 0x55555555 & mask;
+
+  if (0 == syndrome)
+    return SOFTECC_CLEAN;
+
+  /* single data bit flip toggles exactly one bit of every pair,
+     odd bits form its address */
+  if (even == ((syndrome ^ (syndrome >> 1)) & even)) {
+    uint32_t bit = 0;
+    uint32_t byte = 0;
+    for (size_t j=0; j<pairs; j++) {
+      if (syndrome & (1UL << (2 * j + 1))) {
+        if (j < 3)
+          bit |= 1U << j;
+        else
+          byte |= 1UL << (j - 3);
+      }
+    }
+    buf[byte] ^= 1U << bit;
+    return SOFTECC_CORRECTED;
+  }
+
+  /* single flipped bit in ECC, data is good */
+  if (0 == (syndrome & (syndrome - 1)))
+    return SOFTECC_CORRECTED;
+
+  return SOFTECC_UNCORRECTABLE;
+}
@@ -0,0 +1,24 @@
+#ifndef SOFT_ECC_H_
+#define SOFT_ECC_H_
+
+/**
+ * @brief   Result of data check against stored ECC.
+ */
+typedef enum {
+  SOFTECC_CLEAN = 0,
+  /* single bit error fixed, or error found in ECC itself */
+  SOFTECC_CORRECTED,
+  SOFTECC_UNCORRECTABLE
+} softecc_status_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  uint32_t softecc(const uint8_t *buf, size_t len);
+  softecc_status_t softecc_correct(uint8_t *buf, size_t len,
+                                   uint32_t stored, uint32_t calc);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SOFT_ECC_H_ */